@@ -0,0 +1,192 @@
+/**
+ * AMCOM codec microbenchmark.
+ *
+ * Checks the CRC engines against the bytewise reference on random buffers, then reports the throughput of the CRC engines,
+ * of the serializer and of the parser. The codec is included rather than linked, so its internal CRC engines can be reached.
+ */
+#include "../src/amcom.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/// Bytes processed by each measurement
+#define BENCH_BYTES (256u * 1024u * 1024u)
+
+/// Results of the measured loops end up here, so they are not optimized away
+static volatile unsigned benchSink;
+
+static double now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint16_t referenceCRC(const uint8_t* data, size_t size, uint16_t crc) {
+    while (size--) {
+        crc = AMCOM_UpdateCRC(*data++, crc);
+    }
+    return crc;
+}
+
+static void fillRandom(uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(rand() >> 7);
+    }
+}
+
+/**
+ * Compares each CRC engine with the bytewise reference over random buffers of random sizes and random initial values.
+ *
+ * @return number of mismatches
+ */
+static unsigned selfCheck(void) {
+    static uint8_t data[8192];
+    unsigned       mismatches = 0;
+    for (unsigned run = 0; run < 20000; run++) {
+        // short buffers are checked more often, they hit the edges of the slices and the lanes
+        const size_t size = (run % 4) ? (size_t)(rand() % 300) : (size_t)(rand() % sizeof(data));
+        fillRandom(data, size);
+        const uint16_t init      = (uint16_t)rand();
+        const uint16_t reference = referenceCRC(data, size, init);
+        if (AMCOM_UpdateCRCSlicing8(data, size, init) != reference) {
+            printf("slicing-by-8 mismatch: size %zu\n", size);
+            mismatches++;
+        }
+        if (AMCOM_UpdateCRCBlock(data, size, init) != reference) {
+            printf("block mismatch: size %zu\n", size);
+            mismatches++;
+        }
+#if defined(AMCOM_CRC_CLMUL)
+        if (AMCOM_HasClmul() && (size >= AMCOM_CRC_CLMUL_MIN_SIZE) && (AMCOM_UpdateCRCClmul(data, size, init) != reference)) {
+            printf("carry-less multiply mismatch: size %zu\n", size);
+            mismatches++;
+        }
+#endif
+    }
+    // CRC-16/MCRF4XX check value
+    if (referenceCRC((const uint8_t*)"123456789", 9, AMCOM_INITIAL_CRC) != 0x6F91) {
+        printf("reference check value mismatch\n");
+        mismatches++;
+    }
+    return mismatches;
+}
+
+static void report(const char* name, size_t bytes, double seconds, unsigned sink) {
+    benchSink = sink;
+    printf("%-40s %8.3f GB/s\n", name, (double)bytes / seconds * 1e-9);
+}
+
+static void benchCRC(const char* name, uint16_t (*engine)(const uint8_t*, size_t, uint16_t), size_t blockSize) {
+    static uint8_t data[65536];
+    fillRandom(data, blockSize);
+    uint16_t     crc   = AMCOM_INITIAL_CRC;
+    const size_t count = BENCH_BYTES / blockSize;
+    const double start = now();
+    for (size_t i = 0; i < count; i++) {
+        crc = engine(data, blockSize, crc);
+    }
+    report(name, count * blockSize, now() - start, crc);
+}
+
+static uint16_t bytewiseEngine(const uint8_t* data, size_t size, uint16_t crc) {
+    return referenceCRC(data, size, crc);
+}
+
+static void benchSerialize(void) {
+    static uint8_t payload[AMCOM_MAX_JUMBO_PAYLOAD_SIZE];
+    static uint8_t packet[AMCOM_MAX_JUMBO_PACKET_SIZE];
+    fillRandom(payload, sizeof(payload));
+    unsigned sink = 0;
+
+    size_t       count = BENCH_BYTES / AMCOM_MAX_PACKET_SIZE;
+    double       start = now();
+    for (size_t i = 0; i < count; i++) {
+        payload[0] = (uint8_t)i;
+        sink += (unsigned)AMCOM_SerializeHeader(7, AMCOM_MAX_PAYLOAD_SIZE, packet);
+        sink += packet[3];
+    }
+    report("serialize header (200 B payload)", count * AMCOM_MAX_PACKET_SIZE, now() - start, sink);
+
+    count = BENCH_BYTES / AMCOM_MAX_JUMBO_PACKET_SIZE;
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        payload[0] = (uint8_t)i;
+        sink += (unsigned)AMCOM_SerializeJumbo(7, payload, sizeof(payload), packet);
+        sink += packet[4];
+    }
+    report("serialize jumbo (64 KiB payload)", count * AMCOM_MAX_JUMBO_PACKET_SIZE, now() - start, sink);
+}
+
+static void deserializeHandler(const AMCOM_Packet* packet, void* userContext) {
+    *(unsigned*)userContext += packet->header.length;
+}
+
+static void benchDeserialize(void) {
+    // a stream of packets with all the payload sizes, as the responses arrive from the socket
+    static uint8_t stream[1u << 20];
+    size_t         streamSize = 0;
+    uint8_t        payload[AMCOM_MAX_PAYLOAD_SIZE];
+    for (size_t payloadSize = 0; streamSize + AMCOM_MAX_PACKET_SIZE <= sizeof(stream); payloadSize = (payloadSize + 37) % (AMCOM_MAX_PAYLOAD_SIZE + 1)) {
+        fillRandom(payload, payloadSize);
+        memcpy(stream + streamSize + AMCOM_PACKET_OVERHEAD, payload, payloadSize);
+        streamSize += AMCOM_SerializeHeader(10, payloadSize, stream + streamSize);
+    }
+    unsigned     sink  = 0;
+    const size_t count = BENCH_BYTES / streamSize;
+
+    AMCOM_Parser parser;
+    AMCOM_InitParser(&parser);
+    double start = now();
+    for (size_t i = 0; i < count; i++) {
+        // the stream is fed in socket-sized chunks, so some packets are split across chunks
+        for (size_t offset = 0; offset < streamSize;) {
+            const size_t     chunk = (streamSize - offset < 2048) ? (streamSize - offset) : 2048;
+            size_t           parsed = 0;
+            AMCOM_PacketView views[16];
+            while (parsed < chunk) {
+                size_t       consumed;
+                const size_t found = AMCOM_Parse(&parser, stream + offset + parsed, chunk - parsed, views, 16, &consumed);
+                for (size_t v = 0; v < found; v++) {
+                    sink += views[v].crcValid;
+                }
+                parsed += consumed;
+            }
+            offset += chunk;
+        }
+    }
+    report("parse (zero-copy views)", count * streamSize, now() - start, sink);
+
+    AMCOM_Receiver receiver;
+    AMCOM_InitReceiver(&receiver, deserializeHandler, &sink);
+    start = now();
+    for (size_t i = 0; i < count; i++) {
+        AMCOM_Deserialize(&receiver, stream, streamSize);
+    }
+    report("deserialize (bytewise receiver)", count * streamSize, now() - start, sink);
+}
+
+int main(void) {
+    srand(12345);
+    const unsigned mismatches = selfCheck();
+    if (mismatches > 0) {
+        printf("CRC self-check FAILED: %u mismatches\n", mismatches);
+        return 1;
+    }
+    printf("CRC self-check passed\n");
+
+    benchCRC("CRC bytewise (200 B blocks)", bytewiseEngine, 200);
+    benchCRC("CRC slicing-by-8 (200 B blocks)", AMCOM_UpdateCRCSlicing8, 200);
+    benchCRC("CRC slicing-by-8 (64 KiB blocks)", AMCOM_UpdateCRCSlicing8, 65536);
+#if defined(AMCOM_CRC_CLMUL)
+    if (AMCOM_HasClmul()) {
+        benchCRC("CRC carry-less multiply (200 B blocks)", AMCOM_UpdateCRCClmul, 200);
+        benchCRC("CRC carry-less multiply (64 KiB blocks)", AMCOM_UpdateCRCClmul, 65536);
+    } else {
+        printf("CPU without carry-less multiply - skipped\n");
+    }
+#endif
+    benchSerialize();
+    benchDeserialize();
+    return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * World step microbenchmark.
+ *
+ * Steps two identical worlds with a few moving players and thousands of static food, one with each update of the objects after a step:
+ * the lazy update of World::step, which updates the objects whose hitpoints changed only, and the eager update it replaced, which
+ * updated every player and every food (World::setEagerUpdate). The worlds are built from the same positions and stepped in turns, so
+ * both see the same contacts and the same machine state.
+ */
+#include "engine.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <initializer_list>
+#include <random>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    using namespace amgame::engine;
+
+    /// Side length of the map
+    constexpr float mapSize = 10000.0f;
+    /// Moving players in the world
+    constexpr unsigned playerCount = 8;
+    /// Steps measured for each food count
+    constexpr unsigned steps = 500;
+
+    /// Fills the world with the food and the players, the same for the same seed
+    void populate(World& world, unsigned foodCount, unsigned seed) {
+        std::mt19937                          gen(seed);
+        std::uniform_real_distribution<float> position(-mapSize / 2 + Mortal::minRadius, mapSize / 2 - Mortal::minRadius);
+        for (unsigned f = 0; f < foodCount; f++) {
+            const float x = position(gen);
+            world.addFood(b2Vec2(x, position(gen)));
+        }
+        for (unsigned p = 0; p < playerCount; p++) {
+            const float x = position(gen);
+            // the players cross the map in different directions, so they keep meeting food
+            world.addPlayer(b2Vec2(x, position(gen))).setAngle(2.0f * 3.14159265f * float(p) / float(playerCount));
+        }
+        world.init();
+    }
+
+    void measure(unsigned foodCount) {
+        World lazyWorld(mapSize);
+        World eagerWorld(mapSize);
+        populate(lazyWorld, foodCount, foodCount);
+        populate(eagerWorld, foodCount, foodCount);
+        eagerWorld.setEagerUpdate(true);
+
+        std::chrono::nanoseconds lazy{0};
+        std::chrono::nanoseconds eager{0};
+        for (unsigned s = 0; s < steps; s++) {
+            auto const start = Clock::now();
+            lazyWorld.step();
+            auto const lazyDone = Clock::now();
+            eagerWorld.step();
+            eager += Clock::now() - lazyDone;
+            lazy += lazyDone - start;
+        }
+        auto const lazyUs  = std::chrono::duration<double, std::micro>(lazy).count() / steps;
+        auto const eagerUs = std::chrono::duration<double, std::micro>(eager).count() / steps;
+        std::printf("%6u food: lazy step %9.1f us, eager step %9.1f us (%.2fx)\n", foodCount, lazyUs, eagerUs, eagerUs / lazyUs);
+    }
+} // namespace
+
+int main() {
+    for (unsigned foodCount : {1000u, 5000u, 20000u}) {
+        measure(foodCount);
+    }
+    return 0;
+}
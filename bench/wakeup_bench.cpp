@@ -0,0 +1,177 @@
+/**
+ * Connection thread wake-up microbenchmark.
+ *
+ * Measures the latency of a request phase - from scheduling a request to getting its response - for the two ways the connection thread
+ * learns about a scheduled request: polling the queue every 10 ms (the old thread backend) and waiting on the socket and an eventfd
+ * signalled on enqueue (the current thread backend). The connection thread is modelled after ConnectionClient::clientThreadFunc over a
+ * local socket pair, and the peer answers each request at once, so the numbers show the cost of the wake-up path alone.
+ */
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    /// Size of a request and of a response
+    constexpr std::size_t packetSize = 8;
+    /// Request phases run back to back in a game tick (player update, food update, MOVE, eaten food)
+    constexpr unsigned phasesPerTick = 4;
+    /// Ticks measured for each backend
+    constexpr unsigned ticks = 250;
+
+    enum class Backend { sleepPoll, eventfdWake };
+
+    /// A scheduled request, done once its response has arrived
+    struct Request {
+        uint8_t               data[packetSize];
+        std::binary_semaphore done{0};
+    };
+
+    class Connection {
+      public:
+        Connection(int sock, Backend backend) : sock(sock), backend(backend), wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+            thread = std::jthread([this](std::stop_token stop) { run(stop); });
+        }
+
+        ~Connection() {
+            thread.request_stop();
+            wake();
+            thread.join();
+            ::close(wakeFd);
+        }
+
+        /// Schedules the request, as ConnectionClient::runTransaction does
+        void schedule(Request& request) {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                requests.push_back(&request);
+            }
+            if (Backend::eventfdWake == backend) {
+                wake();
+            }
+        }
+
+      private:
+        int                  sock;
+        Backend              backend;
+        int                  wakeFd;
+        std::mutex           mutex;
+        std::deque<Request*> requests;
+        std::deque<Request*> inFlight;
+        std::jthread         thread;
+
+        void wake() {
+            uint64_t              one    = 1;
+            [[maybe_unused]] auto result = write(wakeFd, &one, sizeof(one));
+        }
+
+        void pump() {
+            const std::lock_guard<std::mutex> lock(mutex);
+            while (!requests.empty()) {
+                [[maybe_unused]] auto result = write(sock, requests.front()->data, packetSize);
+                inFlight.push_back(requests.front());
+                requests.pop_front();
+            }
+        }
+
+        void receive() {
+            uint8_t response[packetSize];
+            if ((read(sock, response, packetSize) == ssize_t(packetSize)) && !inFlight.empty()) {
+                inFlight.front()->done.release();
+                inFlight.pop_front();
+            }
+        }
+
+        void run(std::stop_token stop) {
+            while (!stop.stop_requested()) {
+                pump();
+                if (Backend::sleepPoll == backend) {
+                    // the old loop: wait for the responses to the requests in flight, then sleep until the next look at the queue
+                    while (!inFlight.empty()) {
+                        pollfd event{sock, POLLIN, 0};
+                        if (poll(&event, 1, 100) <= 0) {
+                            break;
+                        }
+                        receive();
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                } else {
+                    pollfd events[2] = {{sock, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+                    if (poll(events, 2, 100) > 0) {
+                        if (events[1].revents & POLLIN) {
+                            uint64_t              value;
+                            [[maybe_unused]] auto result = read(wakeFd, &value, sizeof(value));
+                        }
+                        if (events[0].revents & POLLIN) {
+                            receive();
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    /// Answers each request at once
+    void peerFunc(int sock) {
+        uint8_t packet[packetSize];
+        while (read(sock, packet, packetSize) == ssize_t(packetSize)) {
+            if (write(sock, packet, packetSize) != ssize_t(packetSize)) {
+                break;
+            }
+        }
+    }
+
+    void measure(const char* name, Backend backend) {
+        int socks[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks) != 0) {
+            std::perror("socketpair");
+            return;
+        }
+        std::thread                           peer(peerFunc, socks[1]);
+        std::vector<std::chrono::nanoseconds> phases;
+        std::vector<std::chrono::nanoseconds> tickTimes;
+        {
+            Connection connection(socks[0], backend);
+            Request    request;
+            for (unsigned tick = 0; tick < ticks; tick++) {
+                const auto tickStart = Clock::now();
+                for (unsigned phase = 0; phase < phasesPerTick; phase++) {
+                    const auto start = Clock::now();
+                    connection.schedule(request);
+                    request.done.acquire();
+                    phases.push_back(Clock::now() - start);
+                }
+                tickTimes.push_back(Clock::now() - tickStart);
+            }
+        }
+        shutdown(socks[0], SHUT_RDWR);
+        peer.join();
+        ::close(socks[0]);
+        ::close(socks[1]);
+
+        auto percentile = [](std::vector<std::chrono::nanoseconds>& samples, double p) {
+            std::ranges::sort(samples);
+            return std::chrono::duration<double, std::micro>(samples[std::size_t(p * double(samples.size() - 1))]).count();
+        };
+        std::printf("%-14s phase p50 %9.1f us  p99 %9.1f us  max %9.1f us | tick of %u phases p50 %9.1f us\n", name, percentile(phases, 0.5),
+                    percentile(phases, 0.99), percentile(phases, 1.0), phasesPerTick, percentile(tickTimes, 0.5));
+    }
+} // namespace
+
+int main() {
+    measure("sleep-poll", Backend::sleepPoll);
+    measure("eventfd-wake", Backend::eventfdWake);
+    return 0;
+}
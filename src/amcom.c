@@ -1,10 +1,13 @@
 #include "amcom.h"
+#include "amcom_crc_table.h"
 
 #include <stdint.h>
 #include <string.h>
 
 /// Start of packet character
 const uint8_t  AMCOM_SOP         = 0xA1;
+/// Start of jumbo packet character
+const uint8_t  AMCOM_JUMBO_SOP   = 0xA2;
 const uint16_t AMCOM_INITIAL_CRC = 0xFFFF;
 
 /**
@@ -20,16 +23,320 @@ static uint16_t AMCOM_UpdateCRC(uint8_t byte, uint16_t crc) {
     return ((((uint16_t)byte << 8) | (uint8_t)(crc >> 8)) ^ (uint8_t)(byte >> 4) ^ ((uint16_t)byte << 3));
 } /* CRC16_UpdateCRC_Byte */
 
+/**
+ * Updates the CRC given a block of data. Gives the same result as calling AMCOM_UpdateCRC for each byte,
+ * but processes 8 bytes per step using the lookup tables (slicing-by-8).
+ *
+ * @param data block of data
+ * @param size number of bytes in the block
+ * @param crc current crc
+ * @return new crc value
+ */
+static uint16_t AMCOM_UpdateCRCSlicing8(const uint8_t* data, size_t size, uint16_t crc) {
+    while (size >= 8) {
+        // the CRC only overlaps the first two bytes of the slice
+        crc ^= (uint16_t)(data[0] | ((uint16_t)data[1] << 8));
+        crc = AMCOM_CRC_TABLE[7][crc & 0xff] ^ AMCOM_CRC_TABLE[6][crc >> 8] ^ AMCOM_CRC_TABLE[5][data[2]] ^ AMCOM_CRC_TABLE[4][data[3]] ^
+              AMCOM_CRC_TABLE[3][data[4]] ^ AMCOM_CRC_TABLE[2][data[5]] ^ AMCOM_CRC_TABLE[1][data[6]] ^ AMCOM_CRC_TABLE[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    // the tail goes byte by byte
+    while (size--) {
+        crc = (crc >> 8) ^ AMCOM_CRC_TABLE[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+
+/// The carry-less multiply CRC is available (it is used only if the CPU supports it)
+#define AMCOM_CRC_CLMUL 1
+/// Shortest block worth the carry-less multiply CRC
+#define AMCOM_CRC_CLMUL_MIN_SIZE 64
+
+/**
+ * Folds a 128-bit block of the message forward by the distance given by the constants. The block is taken as the reflected
+ * polynomial of 128 bits, the constants are the reflected x^(distance + 63) mod P (low lane) and x^(distance - 1) mod P (high lane).
+ */
+__attribute__((target("pclmul,sse2"))) static inline __m128i AMCOM_FoldCRC(__m128i block, __m128i constants) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(block, constants, 0x00), _mm_clmulepi64_si128(block, constants, 0x11));
+}
+
+/**
+ * Updates the CRC given a block of data. Gives the same result as AMCOM_UpdateCRCSlicing8, but folds the data 64 bytes per
+ * step with the carry-less multiply instruction (PCLMULQDQ), in four independent lanes. The folded 16 bytes and the tail are
+ * finished with the lookup tables.
+ *
+ * @param data block of data (at least AMCOM_CRC_CLMUL_MIN_SIZE bytes)
+ * @param size number of bytes in the block
+ * @param crc current crc
+ * @return new crc value
+ */
+__attribute__((target("pclmul,sse2"))) static uint16_t AMCOM_UpdateCRCClmul(const uint8_t* data, size_t size, uint16_t crc) {
+    const __m128i fold128 = _mm_set_epi64x((long long)0x7EEA000000000000ull, (long long)0xA95D000000000000ull);
+    const __m128i fold256 = _mm_set_epi64x((long long)0x20F3000000000000ull, (long long)0xAAC8000000000000ull);
+    const __m128i fold384 = _mm_set_epi64x((long long)0x8F66000000000000ull, (long long)0x5159000000000000ull);
+    const __m128i fold512 = _mm_set_epi64x((long long)0x7F90000000000000ull, (long long)0x9822000000000000ull);
+
+    // the CRC only overlaps the first two bytes of the data
+    __m128i lane0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)data), _mm_cvtsi32_si128(crc));
+    __m128i lane1 = _mm_loadu_si128((const __m128i*)(data + 16));
+    __m128i lane2 = _mm_loadu_si128((const __m128i*)(data + 32));
+    __m128i lane3 = _mm_loadu_si128((const __m128i*)(data + 48));
+    data += 64;
+    size -= 64;
+    while (size >= 64) {
+        lane0 = _mm_xor_si128(AMCOM_FoldCRC(lane0, fold512), _mm_loadu_si128((const __m128i*)data));
+        lane1 = _mm_xor_si128(AMCOM_FoldCRC(lane1, fold512), _mm_loadu_si128((const __m128i*)(data + 16)));
+        lane2 = _mm_xor_si128(AMCOM_FoldCRC(lane2, fold512), _mm_loadu_si128((const __m128i*)(data + 32)));
+        lane3 = _mm_xor_si128(AMCOM_FoldCRC(lane3, fold512), _mm_loadu_si128((const __m128i*)(data + 48)));
+        data += 64;
+        size -= 64;
+    }
+    // the lanes are folded into the last one
+    __m128i folded = _mm_xor_si128(_mm_xor_si128(AMCOM_FoldCRC(lane0, fold384), AMCOM_FoldCRC(lane1, fold256)), _mm_xor_si128(AMCOM_FoldCRC(lane2, fold128), lane3));
+    while (size >= 16) {
+        folded = _mm_xor_si128(AMCOM_FoldCRC(folded, fold128), _mm_loadu_si128((const __m128i*)data));
+        data += 16;
+        size -= 16;
+    }
+    // the folded block has the same CRC as all the data before it
+    uint8_t block[16];
+    _mm_storeu_si128((__m128i*)block, folded);
+    crc = AMCOM_UpdateCRCSlicing8(block, sizeof(block), 0);
+    return AMCOM_UpdateCRCSlicing8(data, size, crc);
+}
+
+/**
+ * Returns true if the CPU supports the carry-less multiply instruction.
+ */
+static bool AMCOM_HasClmul(void) {
+    static int hasClmul = -1;
+    if (hasClmul < 0) {
+        hasClmul = __builtin_cpu_supports("pclmul") ? 1 : 0;
+    }
+    return (1 == hasClmul);
+}
+#endif
+
+/**
+ * Updates the CRC given a block of data. Gives the same result as calling AMCOM_UpdateCRC for each byte, with the fastest
+ * engine available on the CPU: the carry-less multiply for long blocks if supported, the slicing-by-8 otherwise.
+ *
+ * @param data block of data
+ * @param size number of bytes in the block
+ * @param crc current crc
+ * @return new crc value
+ */
+static uint16_t AMCOM_UpdateCRCBlock(const uint8_t* data, size_t size, uint16_t crc) {
+#if defined(AMCOM_CRC_CLMUL)
+    if ((size >= AMCOM_CRC_CLMUL_MIN_SIZE) && AMCOM_HasClmul()) {
+        return AMCOM_UpdateCRCClmul(data, size, crc);
+    }
+#endif
+    return AMCOM_UpdateCRCSlicing8(data, size, crc);
+}
+
 
 void AMCOM_InitReceiver(AMCOM_Receiver* receiver, AMCOM_PacketHandler packetHandlerCallback, void* userContext) {
-    // TODO
+    if (NULL == receiver) {
+        return;
+    }
+    receiver->payloadCounter      = 0;
+    receiver->receivedPacketState = AMCOM_PACKET_STATE_EMPTY;
+    receiver->packetHandler       = packetHandlerCallback;
+    receiver->userContext         = userContext;
 }
 
 size_t AMCOM_Serialize(uint8_t packetType, const void* payload, size_t payloadSize, uint8_t* destinationBuffer) {
-    // TODO
-    return 0;
+    if ((NULL == destinationBuffer) || (payloadSize > AMCOM_MAX_PAYLOAD_SIZE) || ((payloadSize > 0) && (NULL == payload))) {
+        return 0;
+    }
+    if (payloadSize > 0) {
+        memcpy(destinationBuffer + AMCOM_PACKET_OVERHEAD, payload, payloadSize);
+    }
+    return AMCOM_SerializeHeader(packetType, payloadSize, destinationBuffer);
 }
 
 void AMCOM_Deserialize(AMCOM_Receiver* receiver, const void* data, size_t dataSize) {
-    // TODO
+    if ((NULL == receiver) || (NULL == data)) {
+        return;
+    }
+    const uint8_t*      bytes  = (const uint8_t*)data;
+    AMCOM_Packet* const packet = &receiver->receivedPacket;
+    for (size_t i = 0; i < dataSize; i++) {
+        const uint8_t byte = bytes[i];
+        switch (receiver->receivedPacketState) {
+            case AMCOM_PACKET_STATE_EMPTY:
+                // skip everything up to the next SOP
+                if (AMCOM_SOP == byte) {
+                    packet->header.sop            = byte;
+                    receiver->receivedPacketState = AMCOM_PACKET_STATE_GOT_SOP;
+                }
+                break;
+            case AMCOM_PACKET_STATE_GOT_SOP:
+                packet->header.type           = byte;
+                receiver->receivedPacketState = AMCOM_PACKET_STATE_GOT_TYPE;
+                break;
+            case AMCOM_PACKET_STATE_GOT_TYPE:
+                if (byte <= AMCOM_MAX_PAYLOAD_SIZE) {
+                    packet->header.length         = byte;
+                    receiver->receivedPacketState = AMCOM_PACKET_STATE_GOT_LENGTH;
+                } else {
+                    // not a valid header after all
+                    receiver->receivedPacketState = AMCOM_PACKET_STATE_EMPTY;
+                }
+                break;
+            case AMCOM_PACKET_STATE_GOT_LENGTH:
+                packet->header.crc            = byte;
+                receiver->receivedPacketState = AMCOM_PACKET_STATE_GOT_CRC_LO;
+                break;
+            case AMCOM_PACKET_STATE_GOT_CRC_LO:
+                packet->header.crc |= (uint16_t)byte << 8;
+                receiver->payloadCounter      = 0;
+                receiver->receivedPacketState = (packet->header.length > 0) ? AMCOM_PACKET_STATE_GETTING_PAYLOAD : AMCOM_PACKET_STATE_GOT_WHOLE_PACKET;
+                break;
+            case AMCOM_PACKET_STATE_GETTING_PAYLOAD:
+                packet->payload[receiver->payloadCounter++] = byte;
+                if (receiver->payloadCounter == packet->header.length) {
+                    receiver->receivedPacketState = AMCOM_PACKET_STATE_GOT_WHOLE_PACKET;
+                }
+                break;
+            default:
+                receiver->receivedPacketState = AMCOM_PACKET_STATE_EMPTY;
+                break;
+        }
+        if (AMCOM_PACKET_STATE_GOT_WHOLE_PACKET == receiver->receivedPacketState) {
+            // the CRC covers the TYPE, LENGTH and PAYLOAD fields - packets with a bad CRC are dropped
+            uint16_t crc = AMCOM_UpdateCRC(packet->header.type, AMCOM_INITIAL_CRC);
+            crc          = AMCOM_UpdateCRC(packet->header.length, crc);
+            crc          = AMCOM_UpdateCRCBlock(packet->payload, packet->header.length, crc);
+            if ((crc == packet->header.crc) && (NULL != receiver->packetHandler)) {
+                receiver->packetHandler(packet, receiver->userContext);
+            }
+            receiver->receivedPacketState = AMCOM_PACKET_STATE_EMPTY;
+        }
+    }
+}
+
+size_t AMCOM_SerializeJumbo(uint8_t packetType, const void* payload, size_t payloadSize, uint8_t* destinationBuffer) {
+    if ((NULL == destinationBuffer) || (payloadSize > AMCOM_MAX_JUMBO_PAYLOAD_SIZE) || ((payloadSize > 0) && (NULL == payload))) {
+        return 0;
+    }
+    if (payloadSize > 0) {
+        memcpy(destinationBuffer + AMCOM_JUMBO_PACKET_OVERHEAD, payload, payloadSize);
+    }
+    return AMCOM_SerializeJumboHeader(packetType, payloadSize, destinationBuffer);
+}
+
+size_t AMCOM_SerializeHeader(uint8_t packetType, size_t payloadSize, uint8_t* packetBuffer) {
+    if ((NULL == packetBuffer) || (payloadSize > AMCOM_MAX_PAYLOAD_SIZE)) {
+        return 0;
+    }
+    packetBuffer[0] = AMCOM_SOP;
+    packetBuffer[1] = packetType;
+    packetBuffer[2] = (uint8_t)payloadSize;
+    // the CRC covers the TYPE, LENGTH and PAYLOAD fields
+    uint16_t crc    = AMCOM_UpdateCRCBlock(packetBuffer + 1, 2, AMCOM_INITIAL_CRC);
+    crc             = AMCOM_UpdateCRCBlock(packetBuffer + AMCOM_PACKET_OVERHEAD, payloadSize, crc);
+    packetBuffer[3] = (uint8_t)(crc & 0xff);
+    packetBuffer[4] = (uint8_t)(crc >> 8);
+    return AMCOM_PACKET_OVERHEAD + payloadSize;
+}
+
+size_t AMCOM_SerializeJumboHeader(uint8_t packetType, size_t payloadSize, uint8_t* packetBuffer) {
+    if ((NULL == packetBuffer) || (payloadSize > AMCOM_MAX_JUMBO_PAYLOAD_SIZE)) {
+        return 0;
+    }
+    packetBuffer[0] = AMCOM_JUMBO_SOP;
+    packetBuffer[1] = packetType;
+    packetBuffer[2] = (uint8_t)(payloadSize & 0xff);
+    packetBuffer[3] = (uint8_t)(payloadSize >> 8);
+    // the CRC covers the TYPE, LENGTH and PAYLOAD fields
+    uint16_t crc    = AMCOM_UpdateCRCBlock(packetBuffer + 1, 3, AMCOM_INITIAL_CRC);
+    crc             = AMCOM_UpdateCRCBlock(packetBuffer + AMCOM_JUMBO_PACKET_OVERHEAD, payloadSize, crc);
+    packetBuffer[4] = (uint8_t)(crc & 0xff);
+    packetBuffer[5] = (uint8_t)(crc >> 8);
+    return AMCOM_JUMBO_PACKET_OVERHEAD + payloadSize;
+}
+
+/**
+ * Makes a view of a whole packet.
+ *
+ * @param packet packet bytes (header first)
+ * @return view of the packet
+ */
+static AMCOM_PacketView AMCOM_MakeView(const uint8_t* packet) {
+    AMCOM_PacketView view;
+    view.packet      = packet;
+    view.type        = packet[1];
+    view.payload     = packet + AMCOM_PACKET_OVERHEAD;
+    view.payloadSize = packet[2];
+    view.packetSize  = AMCOM_PACKET_OVERHEAD + view.payloadSize;
+    // the CRC covers the TYPE, LENGTH and PAYLOAD fields
+    uint16_t crc  = AMCOM_UpdateCRCBlock(packet + 1, 2, AMCOM_INITIAL_CRC);
+    crc           = AMCOM_UpdateCRCBlock(view.payload, view.payloadSize, crc);
+    view.crcValid = (crc == (uint16_t)(packet[3] | ((uint16_t)packet[4] << 8)));
+    return view;
+}
+
+void AMCOM_InitParser(AMCOM_Parser* parser) {
+    parser->carryIndex = 0;
+    parser->carrySize  = 0;
+}
+
+size_t AMCOM_Parse(AMCOM_Parser* parser, const void* data, size_t dataSize, AMCOM_PacketView* views, size_t maxViews, size_t* consumed) {
+    const uint8_t* bytes  = (const uint8_t*)data;
+    size_t         offset = 0;
+    size_t         count  = 0;
+
+    // complete the packet carried over from the previous chunk: the header first, then the payload
+    while ((parser->carrySize > 0) && (count < maxViews)) {
+        uint8_t* carry      = parser->carry[parser->carryIndex];
+        size_t   packetSize = (parser->carrySize < AMCOM_PACKET_OVERHEAD) ? AMCOM_PACKET_OVERHEAD : (AMCOM_PACKET_OVERHEAD + carry[2]);
+        if (packetSize > AMCOM_MAX_PACKET_SIZE) {
+            // not a valid header after all - drop it and look for the next SOP
+            parser->carrySize = 0;
+        } else if (parser->carrySize == packetSize) {
+            views[count++]    = AMCOM_MakeView(carry);
+            parser->carrySize = 0;
+        } else if (offset == dataSize) {
+            break;
+        } else {
+            size_t chunk = packetSize - parser->carrySize;
+            if (chunk > dataSize - offset) {
+                chunk = dataSize - offset;
+            }
+            memcpy(carry + parser->carrySize, bytes + offset, chunk);
+            parser->carrySize += chunk;
+            offset += chunk;
+        }
+    }
+
+    // the packets contained in this chunk are not copied
+    while ((parser->carrySize == 0) && (offset < dataSize) && (count < maxViews)) {
+        size_t remaining = dataSize - offset;
+        if ((bytes[offset] != AMCOM_SOP) || ((remaining >= AMCOM_PACKET_OVERHEAD) && (bytes[offset + 2] > AMCOM_MAX_PAYLOAD_SIZE))) {
+            offset++;
+            continue;
+        }
+        if ((remaining < AMCOM_PACKET_OVERHEAD) || (remaining < (size_t)AMCOM_PACKET_OVERHEAD + bytes[offset + 2])) {
+            // the packet is split - carry it over in the other buffer, the view of the last carried packet may still be in use
+            parser->carryIndex ^= 1;
+            memcpy(parser->carry[parser->carryIndex], bytes + offset, remaining);
+            parser->carrySize = remaining;
+            offset            = dataSize;
+            break;
+        }
+        views[count] = AMCOM_MakeView(bytes + offset);
+        offset += views[count].packetSize;
+        count++;
+    }
+
+    if (consumed) {
+        *consumed = offset;
+    }
+    return count;
 }
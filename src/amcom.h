@@ -16,6 +16,19 @@
  * TYPE - byte defining the type of the packet. Valid values are from 0 to 255.
  * LENGTH - number of bytes in the payload. Can range from 0 to 200. 200 is the maximum packet payload length.
  * CRC - a two-byte field (uint16_t) containing the checksum of the packet. Encoding: little-endian (LSB first)
+ *       The checksum covers the TYPE, LENGTH and PAYLOAD fields.
+ *
+ * Jumbo packets (sent only to the clients that negotiated them) have a two-byte length field:
+ *
+ * +--------+--------+--------+--------+--------+--------+-----------------------------------------+
+ * | SOP    | TYPE   | LENGTH          | CRC             | PAYLOAD                                 |
+ * | 1B     | 1B     | 2B              | 2B              | 0..65535B                               |
+ * +--------+--------+--------+--------+--------+--------+-----------------------------------------+
+ * <----- size of header is 6 bytes -------------------->
+ *
+ * SOP - always 0xA2.
+ * LENGTH - number of bytes in the payload. Encoding: little-endian (LSB first)
+ * CRC - as above, covers the TYPE, LENGTH and PAYLOAD fields.
  *
  */
 
@@ -26,6 +39,7 @@ extern "C" {
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <assert.h>
 
 #if defined __ARMCC_VERSION
@@ -60,7 +74,13 @@ enum {
 	/// Maximum size of packet payload
 	AMCOM_MAX_PAYLOAD_SIZE = 200,
 	/// Maximum size of the whole packet
-	AMCOM_MAX_PACKET_SIZE = (200 + sizeof(AMCOM_PacketHeader))
+	AMCOM_MAX_PACKET_SIZE = (200 + sizeof(AMCOM_PacketHeader)),
+	/// Jumbo packet overhead
+	AMCOM_JUMBO_PACKET_OVERHEAD = 6,
+	/// Maximum size of jumbo packet payload
+	AMCOM_MAX_JUMBO_PAYLOAD_SIZE = 65535,
+	/// Maximum size of the whole jumbo packet
+	AMCOM_MAX_JUMBO_PACKET_SIZE = (65535 + 6)
 };
 
 /** Structure defining the packet */
@@ -113,6 +133,26 @@ typedef struct {
 } AMCOM_Receiver;
 
 
+/** View of a packet found by the parser. It points into the parsed data (or into the parser, for a packet split across chunks) */
+typedef struct {
+	const uint8_t* packet;      ///< whole packet (header first)
+	size_t packetSize;          ///< number of bytes in the whole packet
+	uint8_t type;               ///< packet type
+	const uint8_t* payload;     ///< packet payload
+	size_t payloadSize;         ///< number of bytes in the payload
+	bool crcValid;              ///< true if the CRC field matches the packet
+} AMCOM_PacketView;
+
+/** Structure describing the AM packet parser */
+typedef struct {
+	/// Packets split across chunks (two of them, so the view of a completed packet survives the start of the next one)
+	uint8_t carry[2][AMCOM_MAX_PACKET_SIZE];
+	/// Index of the carry buffer in use
+	size_t carryIndex;
+	/// Number of bytes of the split packet carried over so far (0 if none)
+	size_t carrySize;
+} AMCOM_Parser;
+
 /**
  * @brief Initializes the AMCOM packet receiver.
  *
@@ -140,6 +180,43 @@ void AMCOM_InitReceiver(AMCOM_Receiver* receiver, AMCOM_PacketHandler packetHand
  */
 size_t AMCOM_Serialize(uint8_t packetType, const void* payload, size_t payloadSize, uint8_t* destinationBuffer);
 
+/**
+ * @brief Serializes the jumbo packet
+ *
+ * Works as @ref AMCOM_Serialize, but produces a jumbo packet, with a payload of up to AMCOM_MAX_JUMBO_PAYLOAD_SIZE bytes.
+ * @param packetType type of packet
+ * @param payload pointer to the payload data or NULL if the packet has no payload
+ * @param payloadSize number of bytes in the payload or 0 if the packet has no payload
+ * @param destinationBuffer place to store the packet bytes (must be large enough!)
+ *
+ * @return number of bytes written to the destinationBuffer
+ */
+size_t AMCOM_SerializeJumbo(uint8_t packetType, const void* payload, size_t payloadSize, uint8_t* destinationBuffer);
+
+/**
+ * @brief Serializes the header of a packet whose payload is already in place
+ *
+ * Lets the payload be built directly in the packet buffer, at packetBuffer + AMCOM_PACKET_OVERHEAD, without copying it.
+ * @param packetType type of packet
+ * @param payloadSize number of bytes in the payload
+ * @param packetBuffer packet buffer
+ *
+ * @return number of bytes in the whole packet or 0 if the payload is too long
+ */
+size_t AMCOM_SerializeHeader(uint8_t packetType, size_t payloadSize, uint8_t* packetBuffer);
+
+/**
+ * @brief Serializes the header of a jumbo packet whose payload is already in place
+ *
+ * Works as @ref AMCOM_SerializeHeader, with the payload at packetBuffer + AMCOM_JUMBO_PACKET_OVERHEAD.
+ * @param packetType type of packet
+ * @param payloadSize number of bytes in the payload
+ * @param packetBuffer packet buffer
+ *
+ * @return number of bytes in the whole packet or 0 if the payload is too long
+ */
+size_t AMCOM_SerializeJumboHeader(uint8_t packetType, size_t payloadSize, uint8_t* packetBuffer);
+
 /**
  * @brief Deserializes the chunk of data, searching for valid AMCOM packets
  *
@@ -153,6 +230,33 @@ size_t AMCOM_Serialize(uint8_t packetType, const void* payload, size_t payloadSi
  */
 void AMCOM_Deserialize(AMCOM_Receiver* receiver, const void* data, size_t dataSize);
 
+/**
+ * @brief Initializes the AMCOM packet parser.
+ *
+ * @param parser pointer to the AMCOM parser structure
+ */
+void AMCOM_InitParser(AMCOM_Parser* parser);
+
+/**
+ * @brief Parses a chunk of data in one pass, returning views of the packets found
+ *
+ * Unlike @ref AMCOM_Deserialize, the packets are not copied: each view points into the data. Only a packet split
+ * across chunks is carried over in the parser - its view points into the parser. The views are valid until the
+ * data is released, or until the next call for the same parser, whichever comes first.
+ * Bytes that do not start a valid header are skipped - including jumbo packets, which are only sent by the server.
+ * Packets with a bad CRC are reported with crcValid == false.
+ * @param parser pointer to the AMCOM parser structure
+ * @param data incoming data
+ * @param dataSize number of bytes in the incoming data
+ * @param views place to store the views of the packets found
+ * @param maxViews capacity of views (at least 1)
+ * @param consumed place to store the number of bytes parsed (may be NULL). If it is less than dataSize, the views
+ *        filled up and the rest of the data shall be parsed with the next call.
+ *
+ * @return number of views stored
+ */
+size_t AMCOM_Parse(AMCOM_Parser* parser, const void* data, size_t dataSize, AMCOM_PacketView* views, size_t maxViews, size_t* consumed);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,149 @@
+#ifndef AMCOM_CODEC_H_
+#define AMCOM_CODEC_H_
+
+#include "amcom.h"
+#include "amcom_packets.h"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <span>
+
+/**
+ * Compile-time descriptions of the AMCOM packets and the codecs generated from them.
+ *
+ * Each packet is described once in the table below: its type, its payload and its framing. The encoders, batchers and
+ * decoders are generated from the descriptors, with fixed-size buffers - they do no heap allocation and no runtime dispatch
+ * on the packet type.
+ */
+namespace amcom {
+
+    /// Describes a packet with a fixed payload
+    template<AMCOM_PacketType packetType, typename Payload> struct PacketDescriptor {
+        static constexpr AMCOM_PacketType type          = packetType;
+        static constexpr bool             jumbo         = false;
+        static constexpr std::size_t      overhead      = AMCOM_PACKET_OVERHEAD;
+        static constexpr std::size_t      maxPacketSize = overhead + sizeof(Payload);
+        using PayloadType                               = Payload;
+        static_assert(sizeof(Payload) <= AMCOM_MAX_PAYLOAD_SIZE, "payload does not fit the packet");
+    };
+
+    /// Describes a packet with an array of items as its payload, in a standard or a jumbo packet
+    template<AMCOM_PacketType packetType, typename Item, std::size_t maxItems, bool isJumbo = false> struct BatchDescriptor {
+        static constexpr AMCOM_PacketType type          = packetType;
+        static constexpr bool             jumbo         = isJumbo;
+        static constexpr std::size_t      overhead      = isJumbo ? AMCOM_JUMBO_PACKET_OVERHEAD : AMCOM_PACKET_OVERHEAD;
+        static constexpr std::size_t      capacity      = maxItems;
+        static constexpr std::size_t      maxPacketSize = overhead + maxItems * sizeof(Item);
+        using ItemType                                  = Item;
+        static_assert(maxItems * sizeof(Item) <= (isJumbo ? AMCOM_MAX_JUMBO_PAYLOAD_SIZE : AMCOM_MAX_PAYLOAD_SIZE), "items do not fit the packet");
+    };
+
+    /// Describes a batch sent in a jumbo packet, with as many items as fit
+    template<AMCOM_PacketType packetType, typename Item> using JumboBatchDescriptor = BatchDescriptor<packetType, Item, AMCOM_MAX_JUMBO_PAYLOAD_SIZE / sizeof(Item), true>;
+
+    // The packet table
+
+    using IdentifyRequest              = PacketDescriptor<AMCOM_IDENTIFY_REQUEST, AMCOM_IdentifyRequestPayload>;
+    using IdentifyResponse             = PacketDescriptor<AMCOM_IDENTIFY_RESPONSE, AMCOM_IdentifyResponseVersionedPayload>;
+    using NewGameRequest               = PacketDescriptor<AMCOM_NEW_GAME_REQUEST, AMCOM_NewGameRequestPayload>;
+    using NewGameResponse              = PacketDescriptor<AMCOM_NEW_GAME_RESPONSE, AMCOM_NewGameResponsePayload>;
+    using PlayerUpdateRequest          = BatchDescriptor<AMCOM_PLAYER_UPDATE_REQUEST, AMCOM_PlayerState, AMCOM_MAX_PLAYER_UPDATES>;
+    using FoodUpdateRequest            = BatchDescriptor<AMCOM_FOOD_UPDATE_REQUEST, AMCOM_FoodState, AMCOM_MAX_FOOD_UPDATES>;
+    using MoveRequest                  = PacketDescriptor<AMCOM_MOVE_REQUEST, AMCOM_MoveRequestPayload>;
+    using MoveResponse                 = PacketDescriptor<AMCOM_MOVE_RESPONSE, AMCOM_MoveResponsePayload>;
+    using GameOverRequest              = BatchDescriptor<AMCOM_GAME_OVER_REQUEST, AMCOM_PlayerState, AMCOM_MAX_PLAYER_UPDATES>;
+    using GameOverResponse             = PacketDescriptor<AMCOM_GAME_OVER_RESPONSE, AMCOM_GameOverResponsePayload>;
+    using PlayerDeltaUpdateRequest     = BatchDescriptor<AMCOM_PLAYER_DELTA_UPDATE_REQUEST, AMCOM_PlayerDelta, AMCOM_MAX_PLAYER_DELTAS>;
+    using FoodDeltaUpdateRequest       = BatchDescriptor<AMCOM_FOOD_DELTA_UPDATE_REQUEST, AMCOM_FoodDelta, AMCOM_MAX_FOOD_DELTAS>;
+    using PlayerUpdateWideRequest      = JumboBatchDescriptor<AMCOM_PLAYER_UPDATE_REQUEST, AMCOM_PlayerStateWide>;
+    using FoodUpdateWideRequest        = JumboBatchDescriptor<AMCOM_FOOD_UPDATE_REQUEST, AMCOM_FoodStateWide>;
+    using PlayerDeltaUpdateWideRequest = JumboBatchDescriptor<AMCOM_PLAYER_DELTA_UPDATE_REQUEST, AMCOM_PlayerDeltaWide>;
+    using FoodDeltaUpdateWideRequest   = JumboBatchDescriptor<AMCOM_FOOD_DELTA_UPDATE_REQUEST, AMCOM_FoodDeltaWide>;
+    using FoodCompactUpdateRequest     = JumboBatchDescriptor<AMCOM_FOOD_COMPACT_UPDATE_REQUEST, AMCOM_FoodStateCompact>;
+
+    /// Maximum size of the response described by Descriptor (0 for void - no response)
+    template<typename Descriptor> constexpr std::size_t maxResponseSize = Descriptor::maxPacketSize;
+    template<> constexpr std::size_t                    maxResponseSize<void> = 0;
+
+    /// Packet type of the response described by Descriptor (any type for void - no response)
+    template<typename Descriptor> constexpr int responseType = Descriptor::type;
+    template<> constexpr int                    responseType<void> = -1;
+
+    /**
+     * Writes the header of a packet whose payload is already in place.
+     *
+     * @return number of bytes in the whole packet
+     */
+    template<typename Descriptor> std::size_t serializeHeader(uint8_t* packet, std::size_t payloadSize) {
+        if constexpr (Descriptor::jumbo) {
+            return AMCOM_SerializeJumboHeader(Descriptor::type, payloadSize, packet);
+        } else {
+            return AMCOM_SerializeHeader(Descriptor::type, payloadSize, packet);
+        }
+    }
+
+    /**
+     * Encodes packets with a fixed payload. The payload is written straight into the packet buffer.
+     */
+    template<typename Descriptor> class Encoder {
+      public:
+        /**
+         * Encodes the packet. The returned data is valid until the next call.
+         */
+        std::span<const uint8_t> encode(const typename Descriptor::PayloadType& payload) {
+            std::memcpy(buffer.data() + Descriptor::overhead, &payload, sizeof(payload));
+            return {buffer.data(), serializeHeader<Descriptor>(buffer.data(), sizeof(payload))};
+        }
+
+      private:
+        std::array<uint8_t, Descriptor::maxPacketSize> buffer;
+    };
+
+    /**
+     * Gathers items into a batch packet. The items are written straight into the packet buffer.
+     */
+    template<typename Descriptor> class Batcher {
+      public:
+        void add(const typename Descriptor::ItemType& item) {
+            std::memcpy(buffer.data() + Descriptor::overhead + count * sizeof(item), &item, sizeof(item));
+            count++;
+        }
+
+        bool isFull() const { return (count == Descriptor::capacity); }
+
+        bool isEmpty() const { return (count == 0); }
+
+        void clear() { count = 0; }
+
+        /**
+         * Encodes the packet with the items added so far. The returned data is valid until the next change of the batch.
+         */
+        std::span<const uint8_t> encode() { return {buffer.data(), serializeHeader<Descriptor>(buffer.data(), count * sizeof(typename Descriptor::ItemType))}; }
+
+      private:
+        std::array<uint8_t, Descriptor::maxPacketSize> buffer;
+        std::size_t                                    count{0};
+    };
+
+    /**
+     * Decodes a whole packet with a fixed payload. The packet was framed and its CRC checked by the parser of the connection
+     * (see AMCOM_Parse), so only its type and its length are checked here.
+     *
+     * @return the payload, or nothing if the data is not a packet of the described type
+     */
+    template<typename Descriptor> std::optional<typename Descriptor::PayloadType> decode(std::span<const uint8_t> packet) {
+        static_assert(!Descriptor::jumbo, "the clients send standard packets only");
+        if ((packet.size() == Descriptor::maxPacketSize) && (packet[1] == Descriptor::type) && (packet[2] == sizeof(typename Descriptor::PayloadType))) {
+            // the payload is not aligned within the packet
+            typename Descriptor::PayloadType payload;
+            std::memcpy(&payload, packet.data() + Descriptor::overhead, sizeof(payload));
+            return payload;
+        }
+        return std::nullopt;
+    }
+
+} // namespace amcom
+
+#endif /* AMCOM_CODEC_H_ */
@@ -11,6 +11,37 @@
 #define AMCOM_MAX_PLAYER_UPDATES	8
 /// Maximum number of @ref AMCOM_FoodState structures in a FOOD_UPDATE.request packet
 #define AMCOM_MAX_FOOD_UPDATES		16
+/// Maximum number of @ref AMCOM_PlayerDelta structures in a PLAYER_DELTA_UPDATE.request packet
+#define AMCOM_MAX_PLAYER_DELTAS		40
+/// Maximum number of @ref AMCOM_FoodDelta structures in a FOOD_DELTA_UPDATE.request packet
+#define AMCOM_MAX_FOOD_DELTAS		100
+
+/// Protocol version announced by the server in the IDENTIFY.request - higher version number
+#define AMCOM_PROTOCOL_VERSION_HI	0
+/// Protocol version announced by the server in the IDENTIFY.request - lower version number
+#define AMCOM_PROTOCOL_VERSION_LO	5
+/// Protocol version of the clients that send the plain IDENTIFY.response (no delta updates)
+#define AMCOM_PROTOCOL_VERSION_BASE	0x0002
+/// First protocol version with delta updates (encoded as (gameVerHi << 8) | gameVerLo)
+#define AMCOM_PROTOCOL_VERSION_DELTA	0x0003
+/**
+ * First protocol version with wide updates. The PLAYER_UPDATE, FOOD_UPDATE, PLAYER_DELTA_UPDATE and FOOD_DELTA_UPDATE requests
+ * are sent in jumbo packets (see amcom.h), with the wide structures (32-bit player and food numbers) as their items.
+ */
+#define AMCOM_PROTOCOL_VERSION_WIDE	0x0004
+/**
+ * First protocol version with compact food updates. On top of the wide protocol, the state of the available food is sent in
+ * FOOD_COMPACT_UPDATE.request jumbo packets, with quantized positions (see @ref AMCOM_POSITION_SCALE) and no state field.
+ */
+#define AMCOM_PROTOCOL_VERSION_COMPACT	0x0005
+
+/**
+ * Number of quantization steps per map unit of the player positions sent as deltas.
+ *
+ * A client speaking the delta protocol keeps the quantized position q = round(x * AMCOM_POSITION_SCALE) of each player.
+ * A PLAYER_UPDATE.request sets q, a PLAYER_DELTA_UPDATE.request adds dx and dy to q. The position is q / AMCOM_POSITION_SCALE.
+ */
+#define AMCOM_POSITION_SCALE		8
 
 /// Possible packet types
 typedef enum {
@@ -25,6 +56,9 @@ typedef enum {
 	AMCOM_MOVE_RESPONSE = 10,
 	AMCOM_GAME_OVER_REQUEST = 11,
 	AMCOM_GAME_OVER_RESPONSE = 12,
+	AMCOM_PLAYER_DELTA_UPDATE_REQUEST = 13,
+	AMCOM_FOOD_DELTA_UPDATE_REQUEST = 15,
+	AMCOM_FOOD_COMPACT_UPDATE_REQUEST = 17,
 } AMCOM_PacketType;
 
 /// Structure of the IDENTIFY.request packet payload
@@ -47,6 +81,21 @@ typedef struct AMPACKED {
 // static assertion to check that the structure is indeed packed
 static_assert(24 == sizeof(AMCOM_IdentifyResponsePayload), "24 != sizeof(AMCOM_IdentifyResponsePayload)");
 
+/**
+ * Structure of the IDENTIFY.response packet payload sent by the clients that speak a newer protocol version than the base one.
+ * The client answers with the version it will speak - not newer than the one announced in the IDENTIFY.request.
+ */
+typedef struct AMPACKED {
+	/// Player name (including trailing '\0')
+	char playerName[AMCOM_MAX_PLAYER_NAME_LEN];
+	/// Protocol version spoken by the client - higher version number
+	uint8_t gameVerHi;
+	/// Protocol version spoken by the client - lower version number
+	uint8_t gameVerLo;
+} AMCOM_IdentifyResponseVersionedPayload;
+// static assertion to check that the structure is indeed packed
+static_assert(26 == sizeof(AMCOM_IdentifyResponseVersionedPayload), "26 != sizeof(AMCOM_IdentifyResponseVersionedPayload)");
+
 
 /// Structure of the NEW_GAME.request packet payload
 typedef struct AMPACKED {
@@ -90,6 +139,29 @@ typedef struct AMPACKED {
 static_assert(88 == sizeof(AMCOM_PlayerUpdateRequestPayload), "88 != sizeof(AMCOM_PlayerUpdateRequestPayload)");
 
 
+/// Structure describing the change of a single player state since the last update (delta protocol only)
+typedef struct AMPACKED {
+	/// Player number
+	uint8_t playerNo;
+	/// Health points (0 means 'dead')
+	uint16_t hp;
+	/// Change of the quantized X position (see @ref AMCOM_POSITION_SCALE)
+	int8_t dx;
+	/// Change of the quantized Y position (see @ref AMCOM_POSITION_SCALE)
+	int8_t dy;
+} AMCOM_PlayerDelta;
+// static assertion to check that the structure is indeed packed
+static_assert(5 == sizeof(AMCOM_PlayerDelta), "5 != sizeof(AMCOM_PlayerDelta)");
+
+/// Structure of the PLAYER_DELTA_UPDATE.request packet payload. Players that did not change are left out.
+typedef struct AMPACKED {
+	/// array of player deltas - the actual number of items in this array depends on the packet length
+	AMCOM_PlayerDelta playerDelta[AMCOM_MAX_PLAYER_DELTAS];
+} AMCOM_PlayerDeltaUpdateRequestPayload;
+// static assertion to check that the structure is indeed packed
+static_assert(200 == sizeof(AMCOM_PlayerDeltaUpdateRequestPayload), "200 != sizeof(AMCOM_PlayerDeltaUpdateRequestPayload)");
+
+
 /// Structure describing the state of a single food
 typedef struct AMPACKED {
 	// Food number
@@ -113,6 +185,23 @@ typedef struct AMPACKED {
 static_assert(176 == sizeof(AMCOM_FoodUpdateRequestPayload), "176 != sizeof(AMCOM_FoodUpdateRequestPayload)");
 
 
+/// Structure describing a food eaten since the last update (delta protocol only) - its position is known from the FOOD_UPDATE.request
+typedef struct AMPACKED {
+	// Food number
+	uint16_t foodNo;
+} AMCOM_FoodDelta;
+// static assertion to check that the structure is indeed packed
+static_assert(2 == sizeof(AMCOM_FoodDelta), "2 != sizeof(AMCOM_FoodDelta)");
+
+/// Structure of the FOOD_DELTA_UPDATE.request packet payload
+typedef struct AMPACKED {
+	/// array of eaten food - the actual number of items in this array depends on the packet length
+	AMCOM_FoodDelta foodDelta[AMCOM_MAX_FOOD_DELTAS];
+} AMCOM_FoodDeltaUpdateRequestPayload;
+// static assertion to check that the structure is indeed packed
+static_assert(200 == sizeof(AMCOM_FoodDeltaUpdateRequestPayload), "200 != sizeof(AMCOM_FoodDeltaUpdateRequestPayload)");
+
+
 /// Structure of the MOVE.request packet payload
 typedef struct AMPACKED {
 	/// current game time
@@ -147,4 +236,67 @@ typedef struct AMPACKED {
 static_assert(127 == sizeof(AMCOM_GameOverResponsePayload), "127 != sizeof(AMCOM_GameOverResponsePayload)");
 
 
+/// Structure describing the state of a single player (wide protocol only)
+typedef struct AMPACKED {
+	/// Player number
+	uint32_t playerNo;
+	/// Health points (0 means 'dead')
+	uint16_t hp;
+	/// X position on map
+	float x;
+	/// Y position on map
+	float y;
+} AMCOM_PlayerStateWide;
+// static assertion to check that the structure is indeed packed
+static_assert(14 == sizeof(AMCOM_PlayerStateWide), "14 != sizeof(AMCOM_PlayerStateWide)");
+
+/// Structure describing the change of a single player state since the last update (wide protocol only)
+typedef struct AMPACKED {
+	/// Player number
+	uint32_t playerNo;
+	/// Health points (0 means 'dead')
+	uint16_t hp;
+	/// Change of the quantized X position (see @ref AMCOM_POSITION_SCALE)
+	int8_t dx;
+	/// Change of the quantized Y position (see @ref AMCOM_POSITION_SCALE)
+	int8_t dy;
+} AMCOM_PlayerDeltaWide;
+// static assertion to check that the structure is indeed packed
+static_assert(8 == sizeof(AMCOM_PlayerDeltaWide), "8 != sizeof(AMCOM_PlayerDeltaWide)");
+
+/// Structure describing the state of a single food (wide protocol only)
+typedef struct AMPACKED {
+	// Food number
+	uint32_t foodNo;
+	// Food state (1 = available, 0 = eaten)
+	uint8_t state;
+	/// X position on map
+	float x;
+	/// Y position on map
+	float y;
+} AMCOM_FoodStateWide;
+// static assertion to check that the structure is indeed packed
+static_assert(13 == sizeof(AMCOM_FoodStateWide), "13 != sizeof(AMCOM_FoodStateWide)");
+
+/// Structure describing a food eaten since the last update (wide protocol only)
+typedef struct AMPACKED {
+	// Food number
+	uint32_t foodNo;
+} AMCOM_FoodDeltaWide;
+// static assertion to check that the structure is indeed packed
+static_assert(4 == sizeof(AMCOM_FoodDeltaWide), "4 != sizeof(AMCOM_FoodDeltaWide)");
+
+/// Structure describing the state of a single available food (compact protocol only) - the eaten food is sent as @ref AMCOM_FoodStateWide
+typedef struct AMPACKED {
+	// Food number
+	uint32_t foodNo;
+	/// Quantized X position on map (see @ref AMCOM_POSITION_SCALE)
+	int16_t qx;
+	/// Quantized Y position on map (see @ref AMCOM_POSITION_SCALE)
+	int16_t qy;
+} AMCOM_FoodStateCompact;
+// static assertion to check that the structure is indeed packed
+static_assert(8 == sizeof(AMCOM_FoodStateCompact), "8 != sizeof(AMCOM_FoodStateCompact)");
+
+
 #endif /* AMCOM_PACKETS_H_ */
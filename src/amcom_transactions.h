@@ -3,172 +3,187 @@
 #define AMCOM_TRANSACTIONS_H_
 
 #include "amcom.h"
+#include "amcom_codec.h"
 #include "amcom_packets.h"
 #include "connection_server.h"
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <mutex>
 #include <optional>
-#include <tuple>
+#include <string>
+#include <type_traits>
 
 /**
  * This is a transaction template for all AMCOM transactions, that handle both request and response.
+ * The request and the response are described in the packet table (see amcom_codec.h).
  * This class is also a transaction validator, as it implements the required operator()
  */
-template<AMCOM_PacketType requestPacket, AMCOM_PacketType responsePacket, typename RequestPayload, typename ResponsePayload> class AMCOMTransaction :
-    public connection::Transaction,
-    connection::TransactionResponseValidator {
-    using AMCOMTransactionContext = std::tuple<bool, AMCOMTransaction<requestPacket, responsePacket, RequestPayload, ResponsePayload>&, unsigned int>;
-
+template<typename Request, typename Response> class AMCOMTransaction : public connection::Transaction, connection::TransactionResponseValidator {
   public:
-    AMCOMTransaction() : connection::Transaction({requestPayload, sizeof(requestPayload)}, AMCOM_PACKET_OVERHEAD + sizeof(ResponsePayload), *this) { ; }
+    AMCOMTransaction(const typename Request::PayloadType& payload) : connection::Transaction({}, Response::maxPacketSize, *this, Response::type) { request = encoder.encode(payload); }
     virtual ~AMCOMTransaction() { ; }
 
     /**
-     * The job of this operator is to validate the incoming responseData.
+     * Replaces the request, so a finished transaction can be run again with another payload.
      */
-    virtual bool operator()(unsigned int clientId, std::span<const uint8_t> responseData) {
-        AMCOM_Receiver amcomReceiver;
-        // prepare context for the deserializer - this is a set of information that will be used by the AMCOM packetHandler
-        AMCOMTransactionContext context{false, *this, clientId};
-        // prepare AMCOM receiver
-        AMCOM_InitReceiver(&amcomReceiver, packetHandler, (void*)&context);
-        // deserialize - the rest is done in the packetHandler callback
-        AMCOM_Deserialize(&amcomReceiver, responseData.data(), responseData.size());
-        // the callback should have set this to true, if packet was ok
-        return std::get<0>(context);
-    }
+    void updateRequest(const typename Request::PayloadType& payload) { request = encoder.encode(payload); }
 
     /**
-     * Gets the response from a given client.
+     * The job of this operator is to validate the incoming responseData.
      */
-    std::optional<ResponsePayload> getResponse(unsigned int clientId) {
-        std::lock_guard<std::mutex> lock(responsesMutex);
-        if (auto element = responses.find(clientId); element != responses.end()) {
-            return element->second;
-        }
-        return {};
-    }
+    virtual bool operator()(unsigned int clientId, std::span<const uint8_t> responseData) { return amcom::decode<Response>(responseData).has_value(); }
 
-    uint8_t requestPayload[AMCOM_PACKET_OVERHEAD + sizeof(RequestPayload)];
+    /**
+     * Gets the response from a given client. The response is decoded from the client transaction, so nothing is stored on the side.
+     */
+    std::optional<typename Response::PayloadType> getResponse(unsigned int clientId) { return amcom::decode<Response>(connection::Transaction::getResponse(clientId)); }
 
   private:
-    std::mutex                              responsesMutex;
-    std::map<unsigned int, ResponsePayload> responses;
+    amcom::Encoder<Request> encoder;
+};
 
-    void saveResponse(unsigned int clientId, ResponsePayload* payload) {
-        std::lock_guard<std::mutex> lock(responsesMutex);
-        responses.emplace(clientId, *payload);
-    }
 
-    static void packetHandler(const AMCOM_Packet* packet, void* userContext) {
-        // retrieve the context
-        AMCOMTransactionContext& context = *reinterpret_cast<AMCOMTransactionContext*>(userContext);
+/**
+ * This is a transaction template for the AMCOM transactions that send a batch of items. Without the Response, no response is expected.
+ */
+template<typename Request, typename Response = void> class AMCOMBatchTransaction : public connection::Transaction, connection::TransactionResponseValidator {
+  public:
+    AMCOMBatchTransaction() : connection::Transaction({}, amcom::maxResponseSize<Response>, *this, amcom::responseType<Response>) { ; }
+    virtual ~AMCOMBatchTransaction() { ; }
 
-        if (packet->header.type == responsePacket) {
-            // mark that the packet payload is OK
-            std::get<0>(context) = true;
-            // save the response
-            std::get<1>(context).saveResponse(std::get<2>(context), (ResponsePayload*)packet->payload);
-        }
-    }
-};
+    void add(const typename Request::ItemType& item) { batcher.add(item); }
 
+    bool isFull() { return batcher.isFull(); }
 
-class IdentifyTransaction : public AMCOMTransaction<AMCOM_IDENTIFY_REQUEST, AMCOM_IDENTIFY_RESPONSE, AMCOM_IdentifyRequestPayload, AMCOM_IdentifyResponsePayload> {
-  public:
-    IdentifyTransaction() {
-        const AMCOM_IdentifyRequestPayload identifyRequestPayload = {0, 2, 0};
-        // prepare request data
-        AMCOM_Serialize(AMCOM_IDENTIFY_REQUEST, &identifyRequestPayload, sizeof(identifyRequestPayload), requestPayload);
-    }
+    bool isEmpty() { return batcher.isEmpty(); }
 
-    std::string getName(unsigned int clientId) {
-        if (auto r = getResponse(clientId)) {
-            return r.value().playerName;
+    void clear() { batcher.clear(); }
+
+    void updateRequest() { request = batcher.encode(); }
+
+    /**
+     * The job of this operator is to validate the incoming responseData.
+     */
+    virtual bool operator()(unsigned int clientId, std::span<const uint8_t> responseData) {
+        if constexpr (std::is_void_v<Response>) {
+            return true;
         } else {
-            return "???";
+            return amcom::decode<Response>(responseData).has_value();
         }
     }
+
+    /**
+     * Gets the response from a given client.
+     */
+    auto getResponse(unsigned int clientId)
+        requires(!std::is_void_v<Response>)
+    {
+        return amcom::decode<Response>(connection::Transaction::getResponse(clientId));
+    }
+
+  private:
+    amcom::Batcher<Request> batcher;
 };
 
-class NewGameTransaction : public AMCOMTransaction<AMCOM_NEW_GAME_REQUEST, AMCOM_NEW_GAME_RESPONSE, AMCOM_NewGameRequestPayload, AMCOM_NewGameResponsePayload> {
+
+/**
+ * IDENTIFY transaction. It is also used by the server as the handshake run with each accepted client.
+ *
+ * The request announces the newest protocol version the server speaks. Clients that speak the base version answer with the plain
+ * IDENTIFY.response, newer ones append the version they will speak. The handshake outlives its client transactions, so the
+ * identities are kept here.
+ */
+class IdentifyTransaction : public AMCOMTransaction<amcom::IdentifyRequest, amcom::IdentifyResponse>, public connection::Handshake {
   public:
-    NewGameTransaction(uint8_t playerNumber, uint8_t numberOfPlayers) {
-        const AMCOM_NewGameRequestPayload newGame = {playerNumber, numberOfPlayers, 1000, 1000};
-        // prepare request data
-        AMCOM_Serialize(AMCOM_NEW_GAME_REQUEST, &newGame, sizeof(AMCOM_NewGameRequestPayload), requestPayload);
+    IdentifyTransaction() : AMCOMTransaction({AMCOM_PROTOCOL_VERSION_HI, AMCOM_PROTOCOL_VERSION_LO, 0}) { ; }
+
+    /**
+     * Accepts both the plain and the versioned IDENTIFY.response.
+     */
+    bool operator()(unsigned int clientId, std::span<const uint8_t> responseData) override {
+        auto response = amcom::decode<amcom::IdentifyResponse>(responseData);
+        if (!response) {
+            if (auto plainResponse = amcom::decode<amcom::PacketDescriptor<AMCOM_IDENTIFY_RESPONSE, AMCOM_IdentifyResponsePayload>>(responseData)) {
+                // the plain response - the client speaks the base version
+                response.emplace();
+                std::memcpy(response->playerName, plainResponse->playerName, sizeof(response->playerName));
+                response->gameVerHi = AMCOM_PROTOCOL_VERSION_BASE >> 8;
+                response->gameVerLo = AMCOM_PROTOCOL_VERSION_BASE & 0xFF;
+            }
+        }
+        if (response) {
+            std::lock_guard<std::mutex> lock(identitiesMutex);
+            identities.emplace(clientId, *response);
+            return true;
+        }
+        return false;
     }
 
-    std::string getHelloMessage(unsigned int clientId) {
-        if (auto r = getResponse(clientId)) {
-            return r.value().helloMessage;
+    /**
+     * Gets the protocol version spoken by a client, encoded as (gameVerHi << 8) | gameVerLo.
+     */
+    uint16_t getProtocolVersion(unsigned int clientId) {
+        if (auto r = getIdentity(clientId)) {
+            // a client may not speak a newer version than the server announced
+            return std::min<uint16_t>((r.value().gameVerHi << 8) | r.value().gameVerLo, (AMCOM_PROTOCOL_VERSION_HI << 8) | AMCOM_PROTOCOL_VERSION_LO);
         } else {
-            return "";
+            return AMCOM_PROTOCOL_VERSION_BASE;
         }
     }
-};
-
 
-class FoodUpdateTransaction : public connection::Transaction {
-  public:
-    FoodUpdateTransaction() : connection::Transaction({}) {
-        // reserve max space to avoid relocations
-        foodState.reserve(AMCOM_MAX_FOOD_UPDATES);
-    }
-    virtual ~FoodUpdateTransaction() { ; }
+    std::span<const uint8_t> getHandshakeRequest() override { return request; }
 
-    void addFood(const AMCOM_FoodState& food) { foodState.push_back(food); }
+    std::size_t getHandshakeResponseSize() override { return responseSize; }
 
-    bool isFull() { return (foodState.size() == AMCOM_MAX_FOOD_UPDATES); }
+    connection::TransactionResponseValidator& getHandshakeValidator() override { return validator; }
 
-    bool isEmpty() { return foodState.empty(); }
+    int getHandshakeResponseType() override { return responseType; }
 
-    void clear() { foodState.clear(); }
+    std::string getName(unsigned int clientId) override {
+        if (auto r = getIdentity(clientId)) {
+            return r.value().playerName;
+        } else {
+            return "???";
+        }
+    }
 
-    void updateRequest() {
-        size_t requestSize = AMCOM_Serialize(AMCOM_FOOD_UPDATE_REQUEST, foodState.data(), foodState.size() * sizeof(AMCOM_FoodState), requestData);
-        request            = std::span<const uint8_t>(requestData, requestSize);
+    void forget(unsigned int clientId) override {
+        std::lock_guard<std::mutex> lock(identitiesMutex);
+        identities.erase(clientId);
     }
 
   private:
-    std::vector<AMCOM_FoodState> foodState;
-    uint8_t                      requestData[AMCOM_MAX_PACKET_SIZE];
-};
+    std::mutex                                                     identitiesMutex;
+    std::map<unsigned int, AMCOM_IdentifyResponseVersionedPayload> identities;
 
-
-class PlayerUpdateTransaction : public connection::Transaction {
-  public:
-    PlayerUpdateTransaction() : connection::Transaction({}) {
-        // reserve max space to avoid relocations
-        playerState.reserve(AMCOM_MAX_PLAYER_UPDATES);
+    std::optional<AMCOM_IdentifyResponseVersionedPayload> getIdentity(unsigned int clientId) {
+        std::lock_guard<std::mutex> lock(identitiesMutex);
+        if (auto element = identities.find(clientId); element != identities.end()) {
+            return element->second;
+        }
+        return {};
     }
-    virtual ~PlayerUpdateTransaction() { ; }
-
-    void addPlayer(const AMCOM_PlayerState& player) { playerState.push_back(player); }
-
-    bool isFull() { return (playerState.size() == AMCOM_MAX_PLAYER_UPDATES); }
+};
 
-    void clear() { playerState.clear(); }
+class NewGameTransaction : public AMCOMTransaction<amcom::NewGameRequest, amcom::NewGameResponse> {
+  public:
+    NewGameTransaction(uint8_t playerNumber, uint8_t numberOfPlayers) : AMCOMTransaction({playerNumber, numberOfPlayers, 1000, 1000}) { ; }
 
-    void updateRequest() {
-        size_t requestSize = AMCOM_Serialize(AMCOM_PLAYER_UPDATE_REQUEST, playerState.data(), playerState.size() * sizeof(AMCOM_PlayerState), requestData);
-        request            = std::span<const uint8_t>(requestData, requestSize);
+    std::string getHelloMessage(unsigned int clientId) {
+        if (auto r = getResponse(clientId)) {
+            return r.value().helloMessage;
+        } else {
+            return "";
+        }
     }
-
-  private:
-    std::vector<AMCOM_PlayerState> playerState;
-    uint8_t                        requestData[AMCOM_MAX_PACKET_SIZE];
 };
 
 
-class MoveTransaction : public AMCOMTransaction<AMCOM_MOVE_REQUEST, AMCOM_MOVE_RESPONSE, AMCOM_MoveRequestPayload, AMCOM_MoveResponsePayload> {
+class MoveTransaction : public AMCOMTransaction<amcom::MoveRequest, amcom::MoveResponse> {
   public:
-    MoveTransaction(uint32_t gameTime) {
-        const AMCOM_MoveRequestPayload moveRequest = {gameTime};
-        // prepare request data
-        AMCOM_Serialize(AMCOM_MOVE_REQUEST, &moveRequest, sizeof(AMCOM_MoveRequestPayload), requestPayload);
-    }
+    MoveTransaction(uint32_t gameTime) : AMCOMTransaction({gameTime}) { ; }
 
     float getAngle(unsigned int clientId) {
         if (auto r = getResponse(clientId)) {
@@ -180,23 +195,8 @@ class MoveTransaction : public AMCOMTransaction<AMCOM_MOVE_REQUEST, AMCOM_MOVE_R
 };
 
 
-class GameOverTransaction : public AMCOMTransaction<AMCOM_GAME_OVER_REQUEST, AMCOM_GAME_OVER_RESPONSE, AMCOM_GameOverRequestPayload, AMCOM_GameOverResponsePayload> {
+class GameOverTransaction : public AMCOMBatchTransaction<amcom::GameOverRequest, amcom::GameOverResponse> {
   public:
-    GameOverTransaction() {
-        // reserve max space to avoid relocations
-        playerState.reserve(AMCOM_MAX_PLAYER_UPDATES);
-    }
-
-    void addPlayer(const AMCOM_PlayerState& player) { playerState.push_back(player); }
-
-    bool isFull() { return (playerState.size() == AMCOM_MAX_PLAYER_UPDATES); }
-
-    void clear() { playerState.clear(); }
-    void updateRequest() {
-        size_t requestSize = AMCOM_Serialize(AMCOM_GAME_OVER_REQUEST, playerState.data(), playerState.size() * sizeof(AMCOM_PlayerState), requestData);
-        request            = std::span<const uint8_t>(requestData, requestSize);
-    }
-
     std::string getEndMessage(unsigned int clientId) {
         if (auto r = getResponse(clientId)) {
             return r.value().endMessage;
@@ -204,10 +204,17 @@ class GameOverTransaction : public AMCOMTransaction<AMCOM_GAME_OVER_REQUEST, AMC
             return "";
         }
     }
-
-  private:
-    std::vector<AMCOM_PlayerState> playerState;
-    uint8_t                        requestData[AMCOM_MAX_PACKET_SIZE];
 };
 
+/// Update transactions - they need no response
+using PlayerUpdateTransaction          = AMCOMBatchTransaction<amcom::PlayerUpdateRequest>;
+using FoodUpdateTransaction            = AMCOMBatchTransaction<amcom::FoodUpdateRequest>;
+using PlayerDeltaUpdateTransaction     = AMCOMBatchTransaction<amcom::PlayerDeltaUpdateRequest>;
+using FoodDeltaUpdateTransaction       = AMCOMBatchTransaction<amcom::FoodDeltaUpdateRequest>;
+using PlayerUpdateWideTransaction      = AMCOMBatchTransaction<amcom::PlayerUpdateWideRequest>;
+using FoodUpdateWideTransaction        = AMCOMBatchTransaction<amcom::FoodUpdateWideRequest>;
+using PlayerDeltaUpdateWideTransaction = AMCOMBatchTransaction<amcom::PlayerDeltaUpdateWideRequest>;
+using FoodDeltaUpdateWideTransaction   = AMCOMBatchTransaction<amcom::FoodDeltaUpdateWideRequest>;
+using FoodCompactUpdateTransaction     = AMCOMBatchTransaction<amcom::FoodCompactUpdateRequest>;
+
 #endif /* AMCOM_TRANSACTIONS_H_ */
@@ -3,18 +3,48 @@
 #include "food.h"
 #include "player.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <ranges>
 #include <syncstream>
+#include <thread>
 
 
 namespace amgame {
 
-    Game::Game() : numberOfPlayers(), mapWidth(1000), mapHeight(1000), phase(MAIN_MENU), world(1000.0) {}
+    Game::Game(connection::Server& server, IdentifyTransaction& identifyTransaction) :
+        phase(MAIN_MENU), numberOfPlayers(), mapWidth(1000), mapHeight(1000), world(1000.0), identifyTransaction(identifyTransaction), server(server) {
+        // send the whole tick to each client without waiting for responses in between
+        server.setPipelining(true);
+        // the phases of a tick have to fit the tick period, the match setup and the game over run without a budget
+        schedulerPhases.fill(scheduler.addPhase("idle", std::chrono::milliseconds(0)));
+        schedulerPhases[NEW_GAME_REQUEST]          = scheduler.addPhase("new game", std::chrono::milliseconds(0));
+        schedulerPhases[NEW_GAME_RESPONSE]         = scheduler.addPhase("new game response", std::chrono::milliseconds(0));
+        schedulerPhases[FOOD_UPDATE_REQUEST]       = scheduler.addPhase("initial state", std::chrono::milliseconds(0));
+        schedulerPhases[FOOD_UPDATE_RESPONSE]      = scheduler.addPhase("initial state written", std::chrono::milliseconds(0));
+        schedulerPhases[PLAYER_UPDATE_REQUEST]     = scheduler.addPhase("player update", std::chrono::milliseconds(10));
+        schedulerPhases[MOVE_REQUEST]              = scheduler.addPhase("move", std::chrono::milliseconds(60));
+        schedulerPhases[MOVE_RESPONSE]             = scheduler.addPhase("move response", std::chrono::milliseconds(0));
+        schedulerPhases[WORLD_STEP]                = scheduler.addPhase("world step", std::chrono::milliseconds(20));
+        schedulerPhases[EATEN_FOOD_UPDATE_REQUEST] = scheduler.addPhase("food update", std::chrono::milliseconds(10));
+        schedulerPhases[GAME_OVER_REQUEST]         = scheduler.addPhase("game over", std::chrono::milliseconds(0));
+        schedulerPhases[GAME_OVER_RESPONSE]        = scheduler.addPhase("game over response", std::chrono::milliseconds(0));
+    }
 
     Game::~Game() {
         clear();
+        // a game that is not over may still be corked, and the clients may still hold its transactions - they release them once they time out
+        server.uncork(matchClients);
+        while (!areTransactionsFinished()) {
+            std::this_thread::sleep_for(responsePollInterval);
+        }
     }
 
     void Game::clear() {
+        finishWorldStep();
         for (auto& p : players) {
             delete p;
         }
@@ -22,17 +52,25 @@ namespace amgame {
         food.clear();
     }
 
-    void Game::newMatch() {
-        // remove players with dead connection
-        server.removeAllInactiveClients();
-        // get number of players
-        numberOfPlayers = server.getClients().size();
+    void Game::setBackgroundPhysics(bool enabled) {
+        backgroundPhysics = enabled;
+    }
+
+    void Game::setCompactFood(bool enabled) {
+        compactFood = enabled;
+    }
+
+    void Game::newMatch(std::vector<unsigned int> clientIds) {
+        matchClients    = std::move(clientIds);
+        numberOfPlayers = matchClients.size();
         std::osyncstream(std::cout) << "New match with " << (int)numberOfPlayers << " players" << std::endl;
 
         this->mapWidth  = 1000.0;
         this->mapHeight = 1000.0;
 
         phase = NEW_GAME_REQUEST;
+        // the ticks are counted from the start of the match
+        scheduler.restart();
     }
 
     void Game::addBot() {
@@ -53,162 +91,619 @@ namespace amgame {
     }
 
     void Game::positionFood() {
-        for (size_t f = 0; f < players.size() * 6; f++) {
+        for (size_t f = 0; f < players.size() * foodPerPlayer; f++) {
             food.emplace_back(world);
         }
     }
 
+    void Game::leaveOutNarrowClients(std::vector<connection::ClientInfo>& clients, const char* reason) {
+        std::erase_if(clients, [this, reason](const auto& client) {
+            if (identifyTransaction.getProtocolVersion(client.clientId) >= AMCOM_PROTOCOL_VERSION_WIDE) {
+                return false;
+            }
+            std::osyncstream(std::cout) << "Client " << client.clientId << " speaks the narrow protocol, which cannot number the " << reason
+                                        << " of this match - left out" << std::endl;
+            return true;
+        });
+    }
+
+    template<typename T> void Game::broadcastBatch(T& transaction, std::span<const unsigned int> clientIds) {
+        transaction.updateRequest();
+        server.broadcast(transaction.getRequest(), clientIds);
+        transaction.clear();
+    }
+
+    template<typename T> void Game::broadcastFullBatch(T& transaction, std::span<const unsigned int> clientIds) {
+        if (transaction.isFull()) {
+            broadcastBatch(transaction, clientIds);
+        }
+    }
+
+    template<typename T> void Game::broadcastLastBatch(T& transaction, std::span<const unsigned int> clientIds) {
+        if (!transaction.isEmpty()) {
+            broadcastBatch(transaction, clientIds);
+        }
+    }
+
+    void Game::setAreaOfInterest(float radius, float hysteresis) {
+        interestRadius     = radius;
+        interestHysteresis = hysteresis;
+    }
+
+    void Game::setWorldStepExecutor(WorldStepExecutor* executor) {
+        worldStepExecutor = executor;
+    }
+
+    void Game::setCompletionListener(connection::CompletionListener* listener) {
+        completionListener = listener;
+    }
+
+    void Game::stepWorld() {
+        world.step();
+        world.step();
+        world.step();
+        world.step();
+        world.step();
+    }
+
+    void Game::startWorldStep() {
+        if (worldStepExecutor) {
+            worldStepState = WORLD_STEP_QUEUED;
+            worldStepExecutor->submit(*this);
+            return;
+        }
+        worldStep = std::async(backgroundPhysics ? std::launch::async : std::launch::deferred, [this] { stepWorld(); });
+    }
+
+    void Game::runWorldStep() {
+        // the step is run once - by the executor, or by the game if it needs the world first
+        int queued = WORLD_STEP_QUEUED;
+        if (!worldStepState.compare_exchange_strong(queued, WORLD_STEP_RUNNING)) {
+            return;
+        }
+        stepWorld();
+        worldStepState = WORLD_STEP_IDLE;
+        worldStepState.notify_all();
+    }
+
+    void Game::finishWorldStep() {
+        if (worldStep.valid()) {
+            worldStep.get();
+        }
+        // a step not picked up by the executor yet is run right here, one picked up is waited for
+        runWorldStep();
+        worldStepState.wait(WORLD_STEP_RUNNING);
+    }
+
+    void Game::takeSnapshot(bool deltas) {
+        for (auto& p : players) {
+            p->updateSprite();
+        }
+        collectEatenFood();
+        collectPlayerChanges(deltas);
+        if (!interests.empty()) {
+            updateInterests();
+        }
+    }
+
+    void Game::collectEatenFood() {
+        eatenFood.clear();
+        foodStates.resize(food.size());
+        uint32_t foodNo = 0;
+        for (auto& f : food) {
+            // updateSprite reports the food eaten since the last call
+            if (f.updateSprite()) {
+                eatenFood.push_back(foodNo);
+            }
+            foodStates[foodNo] = {static_cast<uint8_t>(f.engineFood.hp()), f.engineFood.getPosition().x, f.engineFood.getPosition().y};
+            foodNo++;
+        }
+    }
+
+    void Game::collectPlayerChanges(bool deltas) {
+        playerBaselines.resize(players.size());
+        playerChanges.resize(players.size());
+        uint32_t playerNo = 0;
+        for (const auto& p : players) {
+            auto& change = playerChanges[playerNo];
+            change.hp    = p->enginePlayer.hp();
+            change.x     = p->enginePlayer.getPosition().x;
+            change.y     = p->enginePlayer.getPosition().y;
+            // the delta protocol clients get the change of the quantized state, or nothing if it did not change
+            auto&      baseline = playerBaselines[playerNo];
+            const long qx       = std::lround(change.x * AMCOM_POSITION_SCALE);
+            const long qy       = std::lround(change.y * AMCOM_POSITION_SCALE);
+            const long dx       = qx - baseline.qx;
+            const long dy       = qy - baseline.qy;
+            // without deltas everybody gets the full state
+            change.changed = !deltas || (dx != 0) || (dy != 0) || (change.hp != baseline.hp);
+            // too far for a delta - the full state resynchronizes the client
+            change.resync = !deltas || (dx < INT8_MIN) || (dx > INT8_MAX) || (dy < INT8_MIN) || (dy > INT8_MAX);
+            change.dx     = change.resync ? 0 : static_cast<int8_t>(dx);
+            change.dy     = change.resync ? 0 : static_cast<int8_t>(dy);
+            baseline      = {qx, qy, change.hp};
+            playerNo++;
+        }
+    }
+
+    void Game::updateInterests() {
+        // the players leave the area further away than they enter it
+        const float leaveRadius = interestRadius + interestHysteresis;
+        for (auto& interest : interests) {
+            interest.enteredPlayers.assign(players.size(), false);
+            interest.enteredFood.clear();
+            foundPlayers.assign(players.size(), false);
+            world.query(players[interest.playerNo]->enginePlayer.getPosition(), leaveRadius, [&](const physics::WorldObject& object, float distance) {
+                if (physics::WorldObject::Type::FOOD == object.type()) {
+                    // the food does not move, so once the client knows it, only its death is sent
+                    const uint32_t foodNo = foodNumbers.at(&object);
+                    if ((distance <= interestRadius) && !interest.knownFood[foodNo]) {
+                        interest.knownFood[foodNo] = true;
+                        interest.enteredFood.push_back(foodNo);
+                    }
+                } else {
+                    const uint32_t playerNo = playerNumbers.at(&object);
+                    foundPlayers[playerNo]  = true;
+                    if ((distance <= interestRadius) && !interest.visiblePlayers[playerNo]) {
+                        interest.visiblePlayers[playerNo] = true;
+                        interest.enteredPlayers[playerNo] = true;
+                    }
+                }
+            });
+            for (uint32_t playerNo = 0; playerNo < players.size(); playerNo++) {
+                // the dead players are no longer in the world, but the client still has to get their death
+                if (interest.visiblePlayers[playerNo] && !foundPlayers[playerNo] && players[playerNo]->enginePlayer.alive()) {
+                    interest.visiblePlayers[playerNo] = false;
+                }
+            }
+        }
+    }
+
+    Game::Recipients Game::recipientsOf(const Interest& interest) const {
+        const std::span<const unsigned int> client(&interest.clientId, 1);
+        if (compactFood && (interest.version >= AMCOM_PROTOCOL_VERSION_COMPACT)) {
+            return {{}, {}, {}, client, {}, client};
+        }
+        if (interest.version >= AMCOM_PROTOCOL_VERSION_WIDE) {
+            return {{}, {}, {}, client, client, {}};
+        }
+        if (interest.version >= AMCOM_PROTOCOL_VERSION_DELTA) {
+            return {client, {}, client, {}, {}, {}};
+        }
+        return {client, client, {}, {}, {}, {}};
+    }
+
+    void Game::broadcastFoodUpdates(bool eatenOnly) {
+        if (interests.empty()) {
+            sendFoodUpdates(eatenOnly ? std::span<const uint32_t>() : allFood, eatenFood, {narrowClients, baseClients, deltaClients, wideClients, wideFoodClients, compactFoodClients});
+            return;
+        }
+        // each client gets the food that entered its area, and the death of the food it knows
+        for (const auto& interest : interests) {
+            knownEatenFood.clear();
+            std::ranges::copy_if(eatenFood, std::back_inserter(knownEatenFood), [&interest](uint32_t foodNo) { return interest.knownFood[foodNo]; });
+            sendFoodUpdates(interest.enteredFood, knownEatenFood, recipientsOf(interest));
+        }
+    }
+
+    void Game::broadcastPlayerUpdates(bool deltas) {
+        if (interests.empty()) {
+            sendPlayerUpdates(deltas, {narrowClients, baseClients, deltaClients, wideClients, wideFoodClients, compactFoodClients}, nullptr);
+            return;
+        }
+        // each client gets the players in its area
+        for (const auto& interest : interests) {
+            sendPlayerUpdates(deltas, recipientsOf(interest), &interest);
+        }
+    }
+
+    void Game::sendFoodUpdates(std::span<const uint32_t> fullFood, std::span<const uint32_t> eaten, const Recipients& to) {
+        // the updates need no response, so a single batch per format is encoded at a time and handed over to the clients
+        for (const uint32_t foodNo : fullFood) {
+            const auto& f = foodStates[foodNo];
+            if (!to.narrow.empty()) {
+                // the narrow clients take part in the matches whose food numbers fit 16 bits only (see leaveOutNarrowClients)
+                foodUpdateTransaction.add({static_cast<uint16_t>(foodNo), f.hp, f.x, f.y});
+                broadcastFullBatch(foodUpdateTransaction, to.narrow);
+            }
+            if (!to.wideFood.empty()) {
+                foodUpdateWideTransaction.add({foodNo, f.hp, f.x, f.y});
+                broadcastFullBatch(foodUpdateWideTransaction, to.wideFood);
+            }
+            if (!to.compactFood.empty()) {
+                // the compact format holds the available food with the position in range only, the rest goes in the wide format
+                const long qx = std::lround(f.x * AMCOM_POSITION_SCALE);
+                const long qy = std::lround(f.y * AMCOM_POSITION_SCALE);
+                if ((f.hp > 0) && (qx >= INT16_MIN) && (qx <= INT16_MAX) && (qy >= INT16_MIN) && (qy <= INT16_MAX)) {
+                    foodCompactUpdateTransaction.add({foodNo, static_cast<int16_t>(qx), static_cast<int16_t>(qy)});
+                    broadcastFullBatch(foodCompactUpdateTransaction, to.compactFood);
+                } else {
+                    foodUncompactedTransaction.add({foodNo, f.hp, f.x, f.y});
+                    broadcastFullBatch(foodUncompactedTransaction, to.compactFood);
+                }
+            }
+        }
+        // the delta protocol clients know the positions of the food, so they only get the numbers of the eaten ones
+        for (const uint32_t foodNo : eaten) {
+            if (!to.base.empty()) {
+                const auto& f = foodStates[foodNo];
+                foodEatenTransaction.add({static_cast<uint16_t>(foodNo), f.hp, f.x, f.y});
+                broadcastFullBatch(foodEatenTransaction, to.base);
+            }
+            if (!to.delta.empty()) {
+                foodDeltaUpdateTransaction.add({static_cast<uint16_t>(foodNo)});
+                broadcastFullBatch(foodDeltaUpdateTransaction, to.delta);
+            }
+            if (!to.wide.empty()) {
+                foodDeltaUpdateWideTransaction.add({foodNo});
+                broadcastFullBatch(foodDeltaUpdateWideTransaction, to.wide);
+            }
+        }
+        broadcastLastBatch(foodUpdateTransaction, to.narrow);
+        broadcastLastBatch(foodEatenTransaction, to.base);
+        broadcastLastBatch(foodUpdateWideTransaction, to.wideFood);
+        broadcastLastBatch(foodCompactUpdateTransaction, to.compactFood);
+        broadcastLastBatch(foodUncompactedTransaction, to.compactFood);
+        broadcastLastBatch(foodDeltaUpdateTransaction, to.delta);
+        broadcastLastBatch(foodDeltaUpdateWideTransaction, to.wide);
+    }
+
+    void Game::sendPlayerUpdates(bool deltas, const Recipients& to, const Interest* interest) {
+        // the updates need no response, so a single batch per format is encoded at a time and handed over to the clients
+        // without deltas everybody gets the full state
+        std::span<const unsigned int> fullStateClients = deltas ? to.base : to.narrow;
+        for (uint32_t playerNo = 0; playerNo < playerChanges.size(); playerNo++) {
+            if (interest && !interest->visiblePlayers[playerNo]) {
+                continue;
+            }
+            const auto& change = playerChanges[playerNo];
+            // the client missed the deltas of a player that just entered its area, so it gets the full state
+            const bool resync = change.resync || (interest && interest->enteredPlayers[playerNo]);
+            if (!fullStateClients.empty()) {
+                // a match has at most maxPlayers players, so the player numbers fit 8 bits
+                playerUpdateTransaction.add({static_cast<uint8_t>(playerNo), change.hp, change.x, change.y});
+                broadcastFullBatch(playerUpdateTransaction, fullStateClients);
+            }
+            if (resync) {
+                if (deltas && !to.delta.empty()) {
+                    playerResyncTransaction.add({static_cast<uint8_t>(playerNo), change.hp, change.x, change.y});
+                    broadcastFullBatch(playerResyncTransaction, to.delta);
+                }
+                if (!to.wide.empty()) {
+                    playerUpdateWideTransaction.add({playerNo, change.hp, change.x, change.y});
+                    broadcastFullBatch(playerUpdateWideTransaction, to.wide);
+                }
+            } else if (change.changed) {
+                if (!to.delta.empty()) {
+                    playerDeltaUpdateTransaction.add({static_cast<uint8_t>(playerNo), change.hp, change.dx, change.dy});
+                    broadcastFullBatch(playerDeltaUpdateTransaction, to.delta);
+                }
+                if (!to.wide.empty()) {
+                    playerDeltaUpdateWideTransaction.add({playerNo, change.hp, change.dx, change.dy});
+                    broadcastFullBatch(playerDeltaUpdateWideTransaction, to.wide);
+                }
+            }
+        }
+        broadcastLastBatch(playerUpdateTransaction, fullStateClients);
+        broadcastLastBatch(playerResyncTransaction, to.delta);
+        broadcastLastBatch(playerUpdateWideTransaction, to.wide);
+        broadcastLastBatch(playerDeltaUpdateTransaction, to.delta);
+        broadcastLastBatch(playerDeltaUpdateWideTransaction, to.wide);
+    }
+
     void Game::update() {
         switch (phase) {
             case NEW_GAME_REQUEST: {
                 // send NEW_GAME.request to all players individually and get responses
-                auto    clients  = server.getClients();
+                // the clients were identified by the server when they connected
+                auto clients = server.getClients();
+                std::erase_if(clients, [this](const auto& client) { return !client.identified || (std::ranges::find(matchClients, client.clientId) == matchClients.end()); });
+                // the numbers of the objects must not wrap around on the clients
+                if (clients.size() > maxPlayers) {
+                    for (const auto& client : clients | std::views::drop(maxPlayers)) {
+                        std::osyncstream(std::cout) << "Client " << client.clientId << " cannot be numbered in a match of more than " << maxPlayers << " players - left out"
+                                                    << std::endl;
+                    }
+                    clients.resize(maxPlayers);
+                }
+                if (clients.size() * foodPerPlayer > narrowFoodLimit) {
+                    leaveOutNarrowClients(clients, "food");
+                }
                 uint8_t playerNo = 0;
+                // the transactions of an earlier setup may still be held by the clients
+                lingeringNewGameTransactions.splice(lingeringNewGameTransactions.end(), newGameTransactions);
                 for (auto& client : clients) {
-                    auto newGameTransaction = NewGameTransaction(playerNo, clients.size());
+                    // each client gets its own player number, but all the requests are dispatched at once
+                    auto& newGameTransaction = newGameTransactions.emplace_back(playerNo, clients.size());
+                    newGameTransaction.setCompletionListener(completionListener);
                     server.runTransactionWithSingleClient(client.clientId, newGameTransaction);
-                    if (1 == newGameTransaction.waitForFinish(std::chrono::milliseconds(500))) {
+                    playerNo++;
+                }
+                newGameClients = std::move(clients);
+                // the handshakes run concurrently, so they share a single deadline
+                responseCutoff = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+                phase          = NEW_GAME_RESPONSE;
+            } break;
+            case NEW_GAME_RESPONSE: {
+                // the game does not block on the clients - the phase is run again until they are done
+                if (!std::ranges::all_of(newGameTransactions, [](auto& transaction) { return transaction.isFinished(); }) && (std::chrono::steady_clock::now() < responseCutoff)) {
+                    break;
+                }
+                auto newGameTransaction = newGameTransactions.begin();
+                for (auto& client : newGameClients) {
+                    if (newGameTransaction->getResponse(client.clientId)) {
                         // add new player
-                        auto p = new Player(*this, world, identifyTransaction.getName(client.clientId), "online", newGameTransaction.getHelloMessage(client.clientId), client.clientId);
+                        auto p = new Player(*this, world, client.name, "online", newGameTransaction->getHelloMessage(client.clientId), client.clientId);
                         players.push_back(p);
                     }
-                    playerNo++;
+                    newGameTransaction++;
+                }
+                // the clients that did not answer in time still hold their transactions, so they are kept until those time out too
+                std::erase_if(lingeringNewGameTransactions, [](auto& transaction) { return transaction.isFinished(); });
+                lingeringNewGameTransactions.splice(lingeringNewGameTransactions.end(), newGameTransactions);
+                // the clients get the updates in the protocol version negotiated at IDENTIFY
+                narrowClients.clear();
+                baseClients.clear();
+                deltaClients.clear();
+                wideClients.clear();
+                wideFoodClients.clear();
+                compactFoodClients.clear();
+                for (const auto& p : players) {
+                    const uint16_t version = identifyTransaction.getProtocolVersion(p->clientId);
+                    if (version >= AMCOM_PROTOCOL_VERSION_WIDE) {
+                        wideClients.push_back(p->clientId);
+                        if (compactFood && (version >= AMCOM_PROTOCOL_VERSION_COMPACT)) {
+                            compactFoodClients.push_back(p->clientId);
+                        } else {
+                            wideFoodClients.push_back(p->clientId);
+                        }
+                        continue;
+                    }
+                    narrowClients.push_back(p->clientId);
+                    if (version >= AMCOM_PROTOCOL_VERSION_DELTA) {
+                        deltaClients.push_back(p->clientId);
+                    } else {
+                        baseClients.push_back(p->clientId);
+                    }
                 }
                 // position players on the screen
                 positionPlayers();
                 // position also food
                 positionFood();
                 world.init();
-                for (auto& p : players) {
-                    p->updateSprite();
-                }
-                for (auto& f : food) {
-                    f.updateSprite();
+                moveAngles.assign(players.size(), std::nullopt);
+                allFood.resize(food.size());
+                std::iota(allFood.begin(), allFood.end(), 0);
+                // with an area of interest each client gets the updates of its surroundings only
+                interests.clear();
+                foodNumbers.clear();
+                playerNumbers.clear();
+                if (interestRadius > 0.0f) {
+                    for (uint32_t playerNo = 0; playerNo < players.size(); playerNo++) {
+                        const auto clientId = players[playerNo]->clientId;
+                        interests.push_back({clientId, identifyTransaction.getProtocolVersion(clientId), playerNo, std::vector<bool>(food.size()),
+                                             std::vector<bool>(players.size()), std::vector<bool>(players.size()), {}});
+                        playerNumbers.emplace(&players[playerNo]->enginePlayer, playerNo);
+                    }
+                    for (uint32_t foodNo = 0; foodNo < food.size(); foodNo++) {
+                        foodNumbers.emplace(&food[foodNo].engineFood, foodNo);
+                    }
                 }
                 // move to next game phase
                 phase = FOOD_UPDATE_REQUEST;
             } break;
             case FOOD_UPDATE_REQUEST: {
-                uint16_t              foodNo = 0;
-                FoodUpdateTransaction foodUpdateTransaction;
-                for (auto& f : food) {
-                    // prepare food state
-                    AMCOM_FoodState foodState;
-                    foodState.foodNo = foodNo;
-                    foodState.state  = f.engineFood.hp();
-                    foodState.x      = f.engineFood.getPosition().x;
-                    foodState.y      = f.engineFood.getPosition().y;
-                    // add it to transaction
-                    foodUpdateTransaction.addFood(foodState);
-
-                    // if we reached the number of food states per transaction or this is the last food in the queue
-                    if ((foodUpdateTransaction.isFull()) || (&f == &food.back())) {
-                        foodUpdateTransaction.updateRequest();
-                        server.runTransaction(foodUpdateTransaction);
-                        foodUpdateTransaction.waitForFinish(std::chrono::milliseconds(100));
-                        foodUpdateTransaction.clear();
-                    }
-                    foodNo++;
+                // the initial world state goes out as one burst per client: all the food and all the players back-to-back
+                snapshotStart      = std::chrono::steady_clock::now();
+                snapshotIoCounters = server.getIoCounters(matchClients);
+                takeSnapshot(false);
+                server.cork(matchClients);
+                broadcastFoodUpdates(false);
+                broadcastPlayerUpdates(false);
+                // an empty transaction closes the burst - it is done once everything before it has been written.
+                // A client that has not written its burst by the deadline still holds the fence, so the fences are kept until they finish.
+                std::erase_if(snapshotFences, [](auto& transaction) { return transaction.isFinished(); });
+                auto& fence = snapshotFences.emplace_back(std::span<const uint8_t>());
+                fence.setCompletionListener(completionListener);
+                server.runTransaction(fence, matchClients);
+                server.uncork(matchClients);
+                responseCutoff = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+                phase          = FOOD_UPDATE_RESPONSE;
+            } break;
+            case FOOD_UPDATE_RESPONSE: {
+                // the game does not block on the clients - the phase is run again until the bursts are written
+                if (!snapshotFences.back().isFinished() && (std::chrono::steady_clock::now() < responseCutoff)) {
+                    break;
                 }
-                // move to next game phase
-                phase = PLAYER_UPDATE_REQUEST;
+                // report the transfer, so it can be tracked across map sizes
+                tickIoCounters = server.getIoCounters(matchClients);
+                std::osyncstream(std::cout) << "Initial state of " << food.size() << " food and " << players.size() << " players sent in "
+                                            << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - snapshotStart).count() << " us ("
+                                            << (tickIoCounters.bytesWritten - snapshotIoCounters.bytesWritten) << " bytes, "
+                                            << (tickIoCounters.writeCalls - snapshotIoCounters.writeCalls) << " writes)" << std::endl;
+                // from now on each tick goes out as a single frame per client
+                server.cork(matchClients);
+                // the physics of the first tick runs while the clients decide on their moves
+                startWorldStep();
+                // the players were just sent, so the first tick starts with the MOVE.request
+                phase = MOVE_REQUEST;
             } break;
             case PLAYER_UPDATE_REQUEST: {
-                uint16_t                playerNo = 0;
-                PlayerUpdateTransaction playerUpdateTransaction;
-                for (const auto& p : players) {
-                    // prepare player state
-                    AMCOM_PlayerState playerState;
-                    playerState.playerNo = playerNo;
-                    playerState.hp       = p->enginePlayer.hp();
-                    playerState.x        = p->enginePlayer.getPosition().x;
-                    playerState.y        = p->enginePlayer.getPosition().y;
-                    // add it to transaction
-                    playerUpdateTransaction.addPlayer(playerState);
-
-                    // if we reached the number of food states per transaction or this is the last food in the queue
-                    if ((playerUpdateTransaction.isFull()) || (&p == &players.back())) {
-                        playerUpdateTransaction.updateRequest();
-                        server.runTransaction(playerUpdateTransaction);
-                        playerUpdateTransaction.waitForFinish(std::chrono::milliseconds(100));
-                        playerUpdateTransaction.clear();
-                    }
-                    playerNo++;
-                }
+                // the updates need no response, so they are never waited for - they go out in one frame with the MOVE.request
+                broadcastPlayerUpdates(true);
                 // move to next game phase
                 phase = MOVE_REQUEST;
             } break;
             case MOVE_REQUEST: {
-                // move to next game phase
-                static uint32_t gameTime;
-                MoveTransaction moveTransaction(gameTime++);
-                server.runTransaction(moveTransaction);
-                moveTransaction.waitForFinish(std::chrono::milliseconds(500));
-                for (const auto& p : players) {
-                    p->enginePlayer.setAngle(moveTransaction.getAngle(p->clientId));
-                }
-                world.step();
-                world.step();
-                world.step();
-                world.step();
-                world.step();
-                for (auto& p : players) {
-                    p->updateSprite();
-                }
-                uint16_t              foodNo = 0;
-                FoodUpdateTransaction foodUpdateTransaction;
-                for (auto& f : food) {
-                    if (f.updateSprite()) {
-                        // prepare food state
-                        AMCOM_FoodState foodState;
-                        foodState.foodNo = foodNo;
-                        foodState.state  = 0;
-                        foodState.x      = f.engineFood.getPosition().x;
-                        foodState.y      = f.engineFood.getPosition().y;
-                        // add it to transaction
-                        foodUpdateTransaction.addFood(foodState);
+                // a finished transaction is reused with its client transactions, so the tick allocates nothing
+                if (spareMoveTransactions.empty()) {
+                    moveTransactions.emplace_back(gameTime).setCompletionListener(completionListener);
+                } else {
+                    moveTransactions.splice(moveTransactions.end(), spareMoveTransactions, spareMoveTransactions.begin());
+                    moveTransactions.back().updateRequest({gameTime});
+                }
+                gameTime++;
+                auto& moveTransaction = moveTransactions.back();
+                server.runTransaction(moveTransaction, matchClients);
+                // send the whole tick frame
+                server.uncork(matchClients);
+                // the responses are waited for until the last client has answered, or until the cutoff derived from the recent response times - within the budget of the phase
+                auto cutoff = moveDeadline.deadline();
+                if (const auto budget = scheduler.getBudget(schedulerPhases[MOVE_REQUEST]); budget.count() > 0) {
+                    cutoff = std::min(cutoff, budget);
+                }
+                responseCutoff = std::chrono::steady_clock::now() + cutoff;
+                phase          = MOVE_RESPONSE;
+            } break;
+            case MOVE_RESPONSE: {
+                // the game does not block on the clients - the phase is run again until they are done
+                auto& moveTransaction = moveTransactions.back();
+                if (!moveTransaction.isFinished() && (std::chrono::steady_clock::now() < responseCutoff)) {
+                    break;
+                }
+                moveTransaction.waitForResults(std::chrono::milliseconds(0), [](const connection::ClientResult& result) {
+                    if (connection::ClientOutcome::DONE != result.outcome) {
+                        std::osyncstream(std::cout) << "Client " << result.clientId << ((connection::ClientOutcome::INVALID == result.outcome) ? " sent an invalid" : " did not send a")
+                                                    << " MOVE.response in time (" << result.latency.count() << " us)" << std::endl;
+                    }
+                });
+                // report the traffic of this tick
+                auto ioCounters = server.getIoCounters(matchClients);
+                std::osyncstream(std::cout) << "Tick " << gameTime << ": " << (ioCounters.writeCalls - tickIoCounters.writeCalls) << " writes, "
+                                            << (ioCounters.bytesWritten - tickIoCounters.bytesWritten) << " bytes" << std::endl;
+                tickIoCounters = ioCounters;
+                for (size_t playerNo = 0; playerNo < players.size(); playerNo++) {
+                    // late players keep moving at their last angle
+                    if (moveTransaction.getResponse(players[playerNo]->clientId)) {
+                        moveAngles[playerNo] = moveTransaction.getAngle(players[playerNo]->clientId);
+                    }
+                }
+                // feed the deadline policy with the transactions that are finished, including the late responses, and keep them for reuse
+                for (auto transaction = moveTransactions.begin(); transaction != moveTransactions.end();) {
+                    auto next = std::next(transaction);
+                    if (transaction->isFinished()) {
+                        transaction->waitForResults(std::chrono::milliseconds(0), [this](const connection::ClientResult& result) {
+                            if (connection::ClientOutcome::DONE == result.outcome) {
+                                moveDeadline.record(result.latency);
+                            } else if (connection::ClientOutcome::TIMEOUT == result.outcome) {
+                                moveDeadline.recordTimeout();
+                            }
+                        });
+                        spareMoveTransactions.splice(spareMoveTransactions.end(), moveTransactions, transaction);
                     }
-                    // if we reached the number of food states per transaction or this is the last food in the queue and we have something to send
-                    if ((foodUpdateTransaction.isFull()) || ((&f == &food.back()) && (!foodUpdateTransaction.isEmpty()))) {
-                        foodUpdateTransaction.updateRequest();
-                        server.runTransaction(foodUpdateTransaction);
-                        foodUpdateTransaction.waitForFinish(std::chrono::milliseconds(100));
-                        foodUpdateTransaction.clear();
+                    transaction = next;
+                }
+                phase = WORLD_STEP;
+            } break;
+            case WORLD_STEP: {
+                // the physics started in the previous tick has to be done before the world is touched
+                finishWorldStep();
+                if (isMatchDecided()) {
+                    finish();
+                    break;
+                }
+                // report the speed of the physics, so the backends can be compared
+                if (0 == gameTime % 100) {
+                    std::osyncstream(std::cout) << "Physics (" << physics::World::backendName << "): " << world.getStepsPerSecond() << " steps/s" << std::endl;
+                }
+                // the moves take effect in the next physics run, one tick after the snapshot the clients answered
+                for (size_t playerNo = 0; playerNo < players.size(); playerNo++) {
+                    if (moveAngles[playerNo]) {
+                        players[playerNo]->enginePlayer.setAngle(*moveAngles[playerNo]);
+                        moveAngles[playerNo].reset();
                     }
-                    foodNo++;
                 }
+                // the updates are sent from the snapshot, so the physics of the next tick may run meanwhile
+                takeSnapshot(true);
+                startWorldStep();
+                phase = EATEN_FOOD_UPDATE_REQUEST;
+            } break;
+            case EATEN_FOOD_UPDATE_REQUEST: {
+                // the next tick frame starts with the food eaten in this tick - held back until the MOVE.request of the next tick is scheduled
+                server.cork(matchClients);
+                broadcastFoodUpdates(true);
                 phase = PLAYER_UPDATE_REQUEST;
             } break;
             case GAME_OVER_REQUEST: {
-                uint16_t            playerNo = 0;
-                GameOverTransaction gameOverTransaction;
+                // nothing may be held back anymore
+                server.uncork(matchClients);
+                finishWorldStep();
+                std::osyncstream(std::cout) << "Game over after " << gameTime << " ticks" << std::endl;
+                // all the batches are sent at once, the clients answer each of them
+                std::erase_if(gameOverTransactions, [](auto& transaction) { return transaction.isFinished(); });
+                const auto firstBatch = gameOverTransactions.size();
+                uint16_t   playerNo   = 0;
                 for (const auto& p : players) {
-                    // prepare food state
+                    if ((gameOverTransactions.size() == firstBatch) || gameOverTransactions.back().isFull()) {
+                        gameOverTransactions.emplace_back().setCompletionListener(completionListener);
+                    }
+                    // prepare player state
                     AMCOM_PlayerState playerState;
                     playerState.playerNo = playerNo;
                     playerState.hp       = p->enginePlayer.hp();
                     playerState.x        = p->enginePlayer.getPosition().x;
                     playerState.y        = p->enginePlayer.getPosition().y;
                     // add it to transaction
-                    gameOverTransaction.addPlayer(playerState);
-
-                    // if we reached the number of food states per transaction or this is the last food in the queue
-                    if ((gameOverTransaction.isFull()) || (&p == &players.back())) {
-                        gameOverTransaction.updateRequest();
-                        server.runTransaction(gameOverTransaction);
-                        gameOverTransaction.waitForFinish(std::chrono::milliseconds(100));
-                        gameOverTransaction.clear();
-                    }
+                    gameOverTransactions.back().add(playerState);
                     playerNo++;
                 }
+                for (auto& gameOverTransaction : gameOverTransactions | std::views::drop(firstBatch)) {
+                    gameOverTransaction.updateRequest();
+                    server.runTransaction(gameOverTransaction, matchClients);
+                }
+                responseCutoff = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+                phase          = GAME_OVER_RESPONSE;
+            } break;
+            case GAME_OVER_RESPONSE: {
+                // the game does not block on the clients - the phase is run again until they have answered
+                if (!std::ranges::all_of(gameOverTransactions, [](auto& transaction) { return transaction.isFinished(); }) && (std::chrono::steady_clock::now() < responseCutoff)) {
+                    break;
+                }
                 phase = GAME_END;
             } break;
             case GAME_END: break;
         } // switch (phase)
     }
 
+    TickScheduler::Clock::time_point Game::runTick() {
+        // the phases run until the next tick starts with the player updates, until the game waits for the clients, or until there is nothing left to do
+        for (;;) {
+            const auto current = phase;
+            scheduler.run(schedulerPhases[current], [this] { update(); });
+            const bool waiting = (NEW_GAME_RESPONSE == phase) || (FOOD_UPDATE_RESPONSE == phase) || (MOVE_RESPONSE == phase) || (GAME_OVER_RESPONSE == phase);
+            if (waiting && (current == phase)) {
+                // the tick goes on once the clients had the time to answer - or earlier, once the listener tells they have
+                return completionListener ? responseCutoff : std::min(responseCutoff, TickScheduler::Clock::now() + responsePollInterval);
+            }
+            if ((phase == current) || (phase == PLAYER_UPDATE_REQUEST)) {
+                break;
+            }
+        }
+        return scheduler.finishTick();
+    }
+
     void Game::finish() {
         phase = GAME_OVER_REQUEST;
     }
 
+    void Game::setTickLimit(uint32_t ticks) {
+        tickLimit = ticks;
+    }
+
+    bool Game::isMatchDecided() {
+        if ((tickLimit > 0) && (gameTime >= tickLimit)) {
+            return true;
+        }
+        // the players whose clients are gone are out of the match, even though they keep moving
+        const auto left = std::ranges::count_if(players, [this](const Player* p) { return p->enginePlayer.alive() && server.isClientActive(p->clientId); });
+        // a match of a single player goes on until the player is out
+        return (left == 0) || ((players.size() > 1) && (left == 1));
+    }
+
+    bool Game::areTransactionsFinished() {
+        auto finished = [](auto& transactions) { return std::ranges::all_of(transactions, [](auto& transaction) { return transaction.isFinished(); }); };
+        return finished(newGameTransactions) && finished(lingeringNewGameTransactions) && finished(snapshotFences) && finished(moveTransactions) &&
+               finished(gameOverTransactions);
+    }
+
 } // namespace amgame
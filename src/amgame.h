@@ -2,48 +2,337 @@
 #define AMGAME_H_
 
 #include "amcom_transactions.h"
+#include "connection_deadline_policy.h"
 #include "connection_server.h"
-#include "engine.hpp"
+#include "physics.hpp"
 #include "food.h"
 #include "player.h"
 #include "remote_connection.h"
+#include "tick_scheduler.h"
 
+#include <array>
+#include <atomic>
+#include <future>
 #include <list>
+#include <optional>
+#include <span>
+#include <unordered_map>
 #include <vector>
 
 namespace amgame {
+    class Game;
+
+    /**
+     * Runs the physics of the games on threads that are free, e.g. the idle shards of a match host.
+     *
+     * A game hands the physics of the next tick over with submit() and goes on sending the snapshot. The executor calls
+     * Game::runWorldStep() once a thread is free, and the game runs the step itself if it needs the world before that happened.
+     */
+    class WorldStepExecutor {
+      public:
+        virtual void submit(Game& game) = 0;
+        virtual ~WorldStepExecutor() { ; }
+    };
 
     class Game {
         friend class Player;
 
       private:
         /// phase of the game
-        enum { MAIN_MENU, TESTER, GAME_IDLE, NEW_GAME_REQUEST, PLAYER_UPDATE_REQUEST, FOOD_UPDATE_REQUEST, MOVE_REQUEST, GAME_OVER_REQUEST, GAME_END } phase;
+        enum {
+            MAIN_MENU,
+            TESTER,
+            GAME_IDLE,
+            NEW_GAME_REQUEST,
+            NEW_GAME_RESPONSE,
+            PLAYER_UPDATE_REQUEST,
+            FOOD_UPDATE_REQUEST,
+            FOOD_UPDATE_RESPONSE,
+            MOVE_REQUEST,
+            MOVE_RESPONSE,
+            WORLD_STEP,
+            EATEN_FOOD_UPDATE_REQUEST,
+            GAME_OVER_REQUEST,
+            GAME_OVER_RESPONSE,
+            GAME_END
+        } phase;
+        /// Scheduler phase of each game phase
+        std::array<std::size_t, GAME_END + 1> schedulerPhases;
 
         size_t        numberOfPlayers;
         float         mapWidth;
         float         mapHeight;
-        engine::World world;
+        physics::World world;
+
+        /// IDs of the clients taking part in the match
+        std::vector<unsigned int> matchClients;
+        /// Number of the current tick, sent in the MOVE.request
+        uint32_t gameTime{0};
+        /// Number of ticks after which the match ends (0 - no limit)
+        uint32_t tickLimit{3000};
+        /// Time at which the responses of the current phase (NEW_GAME, the initial state, MOVE, GAME_OVER) stop being waited for
+        TickScheduler::Clock::time_point responseCutoff;
+        /// How often the responses are checked while the game waits for them, unless the completion listener tells when they are in
+        constexpr static std::chrono::microseconds responsePollInterval{1000};
+        /// Told when a transaction of the game has finished (optional)
+        connection::CompletionListener* completionListener{nullptr};
+        /// If set, the physics runs on a thread of its own while the snapshot is sent, otherwise it runs on the thread of the game
+        bool backgroundPhysics{true};
+        /// MOVE.request transactions, kept until every client has answered or timed out (late answers still arrive after the tick cutoff)
+        std::list<MoveTransaction> moveTransactions;
+        /// Finished MOVE.request transactions, reused by the next ticks
+        std::list<MoveTransaction> spareMoveTransactions;
+        /// NEW_GAME.request transactions of the match being set up, and the clients they were sent to
+        std::list<NewGameTransaction>         newGameTransactions;
+        std::vector<connection::ClientInfo>   newGameClients;
+        /// NEW_GAME.request transactions not answered in time, kept until the clients time them out
+        std::list<NewGameTransaction> lingeringNewGameTransactions;
+        /// Empty transactions closing the initial state burst, kept until every client has written its burst
+        std::list<connection::Transaction> snapshotFences;
+        /// Start of the initial state burst and the traffic counters at its start
+        TickScheduler::Clock::time_point snapshotStart;
+        connection::IoCounters           snapshotIoCounters{0, 0};
+        /// GAME_OVER.request transactions (one per batch of players), kept until every client has answered or timed out
+        std::list<GameOverTransaction> gameOverTransactions;
+        /// Policy setting the MOVE.request cutoff of each tick
+        connection::DeadlinePolicy moveDeadline;
+        /// Traffic counters at the start of the tick
+        connection::IoCounters tickIoCounters{0, 0};
+
+        /// Player state known to the delta protocol clients
+        struct PlayerBaseline {
+            /// Quantized position (see AMCOM_POSITION_SCALE)
+            long     qx;
+            long     qy;
+            uint16_t hp;
+        };
+        /// IDs of the clients taking part in the match that get the standard packets (base and delta protocol)
+        std::vector<unsigned int> narrowClients;
+        /// IDs of the clients taking part in the match that speak the base protocol
+        std::vector<unsigned int> baseClients;
+        /// IDs of the clients taking part in the match that speak the delta protocol
+        std::vector<unsigned int> deltaClients;
+        /// IDs of the clients taking part in the match that speak the wide protocol (deltas in jumbo packets)
+        std::vector<unsigned int> wideClients;
+        /// IDs of the wide protocol clients that get the state of the food in the wide format
+        std::vector<unsigned int> wideFoodClients;
+        /// IDs of the wide protocol clients that get the state of the available food in the compact format
+        std::vector<unsigned int> compactFoodClients;
+        /// If set, the clients that speak the compact protocol get the state of the food in the compact format
+        bool compactFood{true};
+        /// Player state last sent to the delta and wide protocol clients, indexed by player number. TCP delivers it in order, so it is what they hold.
+        std::vector<PlayerBaseline> playerBaselines;
+
+        /// Change of a player in the current tick, the same for all the clients
+        struct PlayerChange {
+            uint16_t hp;
+            float    x;
+            float    y;
+            /// Change of the quantized position (valid unless resync is set)
+            int8_t dx;
+            int8_t dy;
+            /// The quantized state differs from the baseline
+            bool changed;
+            /// The change does not fit a delta - the full state resynchronizes the clients
+            bool resync;
+        };
+        /// Changes of the players in the current tick, indexed by player number
+        std::vector<PlayerChange> playerChanges;
+        /// Numbers of all the food (the initial update)
+        std::vector<uint32_t> allFood;
+        /// Numbers of the food eaten in the current tick
+        std::vector<uint32_t> eatenFood;
+        /// State of a food at the snapshot
+        struct FoodState {
+            uint8_t hp;
+            float   x;
+            float   y;
+        };
+        /// States of the food at the snapshot, indexed by food number
+        std::vector<FoodState> foodStates;
+
+        /// Physics of the next tick, running while the snapshot of the current one is sent
+        std::future<void> worldStep;
+        /// Runs the physics of the next tick instead of a thread of its own (optional)
+        WorldStepExecutor* worldStepExecutor{nullptr};
+        /// State of the physics handed over to the executor
+        enum { WORLD_STEP_IDLE, WORLD_STEP_QUEUED, WORLD_STEP_RUNNING };
+        std::atomic<int> worldStepState{WORLD_STEP_IDLE};
+        /// Steps the world by a tick
+        void stepWorld();
+        /// Angles from the MOVE.responses, indexed by player number - applied once the physics is idle
+        std::vector<std::optional<float>> moveAngles;
+
+        /// Clients an update goes to, grouped by the format they get
+        struct Recipients {
+            /// standard packets (base and delta protocol)
+            std::span<const unsigned int> narrow;
+            std::span<const unsigned int> base;
+            std::span<const unsigned int> delta;
+            std::span<const unsigned int> wide;
+            /// full food state of the wide protocol clients, in the wide or in the compact format
+            std::span<const unsigned int> wideFood;
+            std::span<const unsigned int> compactFood;
+        };
+        /// Area of interest of a client - the entities around its player
+        struct Interest {
+            unsigned int clientId;
+            /// Protocol version negotiated at IDENTIFY
+            uint16_t version;
+            /// Number of the player of the client, in the center of the area
+            uint32_t playerNo;
+            /// Food the client got the state of, indexed by food number
+            std::vector<bool> knownFood;
+            /// Players the client gets the updates of, indexed by player number
+            std::vector<bool> visiblePlayers;
+            /// Players that became visible in the current tick - the client gets their full state
+            std::vector<bool> enteredPlayers;
+            /// Numbers of the food that entered the area in the current tick
+            std::vector<uint32_t> enteredFood;
+        };
+        /// Radius of the area of interest (0 - every client gets everything)
+        float interestRadius{0.0f};
+        /// Distance beyond the radius a player has to move away to leave the area of interest
+        float interestHysteresis{0.0f};
+        /// Areas of interest of the clients taking part in the match (empty if the updates are not filtered)
+        std::vector<Interest> interests;
+        /// Food and player numbers of the engine objects found by the area queries
+        std::unordered_map<const physics::WorldObject*, uint32_t> foodNumbers;
+        std::unordered_map<const physics::WorldObject*, uint32_t> playerNumbers;
+        /// Batches of the updates, one per format. Each batch is copied when it is broadcast, so the buffers (up to 64 KiB for the
+        /// jumbo ones) are reused by every update instead of being set up on the stack each time
+        FoodUpdateTransaction            foodUpdateTransaction;
+        FoodUpdateTransaction            foodEatenTransaction;
+        FoodDeltaUpdateTransaction       foodDeltaUpdateTransaction;
+        FoodUpdateWideTransaction        foodUpdateWideTransaction;
+        FoodDeltaUpdateWideTransaction   foodDeltaUpdateWideTransaction;
+        FoodCompactUpdateTransaction     foodCompactUpdateTransaction;
+        FoodUpdateWideTransaction        foodUncompactedTransaction;
+        PlayerUpdateTransaction          playerUpdateTransaction;
+        PlayerUpdateTransaction          playerResyncTransaction;
+        PlayerDeltaUpdateTransaction     playerDeltaUpdateTransaction;
+        PlayerUpdateWideTransaction      playerUpdateWideTransaction;
+        PlayerDeltaUpdateWideTransaction playerDeltaUpdateWideTransaction;
+        /// Food eaten in the current tick known to a client (scratch buffer)
+        std::vector<uint32_t> knownEatenFood;
+        /// Players found by the last area query (scratch buffer)
+        std::vector<bool> foundPlayers;
 
         size_t countFinishedTransactions();
+        /// Returns true if the match is to end: the tick limit is reached, or at most one of the players is alive and connected
+        bool isMatchDecided();
+        /// Returns true if no client holds any transaction of the game anymore
+        bool areTransactionsFinished();
+        /// Starts the physics of the next tick in the background
+        void startWorldStep();
+        /// Waits for the physics to finish, so the world may be accessed
+        void finishWorldStep();
+        /// Copies the state of the world to be sent (players, food, areas of interest) - the physics must not be running
+        void takeSnapshot(bool deltas);
+        /// Collects the food eaten since the last call into eatenFood and the state of all the food into foodStates
+        void collectEatenFood();
+        /// Collects the changes of the players into playerChanges and moves the baselines on
+        void collectPlayerChanges(bool deltas);
+        /// Queries the world for the entities around the player of each client and updates the areas of interest
+        void updateInterests();
+        /// Recipients made of a single client, in the format of its protocol
+        Recipients recipientsOf(const Interest& interest) const;
+        /// Broadcasts the state of all the food (or only of the food eaten in the snapshot) in as many batches as needed
+        void broadcastFoodUpdates(bool eatenOnly);
+        /// Broadcasts the state of the players in the snapshot in as many batches as needed - as deltas to the clients that speak the delta protocol
+        void broadcastPlayerUpdates(bool deltas);
+        /// Sends the full state of fullFood and the eaten state of eaten
+        void sendFoodUpdates(std::span<const uint32_t> fullFood, std::span<const uint32_t> eaten, const Recipients& to);
+        /// Sends the collected player changes, limited to the visible players if the interest is given
+        void sendPlayerUpdates(bool deltas, const Recipients& to, const Interest* interest);
+        /// Encodes a batch and broadcasts it to the given clients
+        template<typename T> void broadcastBatch(T& transaction, std::span<const unsigned int> clientIds);
+        /// Broadcasts the batch if it is full
+        template<typename T> void broadcastFullBatch(T& transaction, std::span<const unsigned int> clientIds);
+        /// Broadcasts the batch if it is not empty
+        template<typename T> void broadcastLastBatch(T& transaction, std::span<const unsigned int> clientIds);
         void   positionPlayers();
         void   positionFood();
+        /// Number of the players a match can have - the NEW_GAME.request of every protocol version numbers the players with 8 bits
+        constexpr static std::size_t maxPlayers{UINT8_MAX};
+        /// Food put into the world for each player
+        constexpr static std::size_t foodPerPlayer{6};
+        /// Number of the food the narrow protocol can address (16-bit food numbers)
+        constexpr static std::size_t narrowFoodLimit{UINT16_MAX + 1};
+        /// Leaves the clients that speak a protocol older than the wide one out of the match, as they cannot address all of its objects
+        void leaveOutNarrowClients(std::vector<connection::ClientInfo>& clients, const char* reason);
 
       public:
         /// List of players
         std::deque<amgame::Player*> players;
         /// List of food
         std::deque<Food> food;
-        /// Connection server
-        connection::Server server{2001, 8};
-        // Identify transaction
-        IdentifyTransaction identifyTransaction;
-        Game();
+        /// Identify transaction, run by the server with each accepted client - holds the negotiated protocol versions
+        IdentifyTransaction& identifyTransaction;
+        /// Connection server, shared with the other matches
+        connection::Server& server;
+        /// Tick scheduler - the tick rate and the budgets of the phases may be changed before the match
+        TickScheduler scheduler{std::chrono::milliseconds(100)};
+        Game(connection::Server& server, IdentifyTransaction& identifyTransaction);
         ~Game();
         void addBot();
+        /**
+         * Limits the updates sent to each client to the entities within the radius from its player.
+         * A player has to move beyond radius + hysteresis to leave the area, so the players on the edge do not flap in and out.
+         * Takes effect with the next match.
+         *
+         * @param radius radius of the area of interest, 0 sends everything to every client
+         * @param hysteresis additional distance at which the players leave the area
+         */
+        void setAreaOfInterest(float radius, float hysteresis);
+        /**
+         * Selects where the physics runs. A game hosted with many others runs it on its own thread, which is already busy with the other games.
+         */
+        void setBackgroundPhysics(bool enabled);
+        /**
+         * Hands the physics over to the executor instead (nullptr - the physics runs as selected by setBackgroundPhysics), so a game hosted
+         * with many others gets its physics run by a free thread while it sends the snapshot. The executor must outlive the game.
+         */
+        void setWorldStepExecutor(WorldStepExecutor* executor);
+        /**
+         * Sets the listener told whenever a transaction of the game has finished. While the game waits for the clients, runTick then
+         * returns the response cutoff rather than the next poll of the responses, and whoever runs the game is to call runTick as soon
+         * as the listener is told. The listener must outlive the game.
+         */
+        void setCompletionListener(connection::CompletionListener* listener);
+        /**
+         * Runs the physics handed over to the executor, unless it has already been run. Called by the executor on any thread.
+         */
+        void runWorldStep();
+        /**
+         * Sets the number of ticks after which the match ends (0 - the match ends only once at most one player is left).
+         * Takes effect with the next match.
+         */
+        void setTickLimit(uint32_t ticks);
+        /**
+         * Selects whether the clients that speak the compact protocol get the state of the food in the compact format (quantized
+         * positions, about 40% fewer bytes than the wide format) - most of the initial state burst is food. Takes effect with the next match.
+         */
+        void setCompactFood(bool enabled);
         void clear();
-        void newMatch();
+        /**
+         * Starts a new match.
+         *
+         * @param clientIds IDs of the identified clients taking part in the match
+         */
+        void newMatch(std::vector<unsigned int> clientIds);
         void update();
+        /**
+         * Runs the game phases of a tick (player updates, MOVE.request, world step, eaten food), or of the match setup and end. Does not
+         * wait for the clients - returns while their responses are pending and continues the tick when called again.
+         *
+         * @return time at which runTick is to be called again - the start of the next tick, or the next check of the responses (the
+         * response cutoff with a completion listener)
+         */
+        TickScheduler::Clock::time_point runTick();
+        /// Returns true once the game is over and no client holds any of its transactions, so it may be destroyed
+        bool isOver() { return (GAME_END == phase) && areTransactionsFinished(); }
+        /// Ends the match with the next phase - the clients get the GAME_OVER.request
         void finish();
     };
 
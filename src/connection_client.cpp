@@ -1,4 +1,17 @@
 #include "connection_client.h"
+#include "connection_reactor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#if !defined(_WIN32)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 #include <iostream>
 #include <thread>
 #include <numeric>
@@ -6,25 +19,105 @@
 
 namespace connection {
 
-ConnectionClient::ConnectionClient(unsigned int clientId, sockpp::tcp_socket sock) : clientId(clientId) {
-	ip = sock.peer_address().to_string();
-	// Create a thread and transfer the new stream to it.
-	clientThread = std::jthread(clientThreadFunc, std::ref(*this), std::move(sock));
+ConnectionClient::ConnectionClient(unsigned int clientId, sockpp::tcp_socket sock) : clientId(clientId), sock(std::move(sock)) {
+	ip = this->sock.peer_address().to_string();
+	// requests are gathered into whole frames by the server, so the socket itself should not delay them
+	this->sock.set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+	// responses are framed from the byte stream, however it is split or merged by TCP
+	AMCOM_InitParser(&parser);
+#if defined(__linux__)
+	// the connection thread waits on the socket and on this event, so a scheduled request wakes it even while a response is awaited
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeFd < 0) {
+		std::osyncstream(std::cerr) << "Unable to create wakeup event. Aborting" << std::endl;
+		abort();
+	}
+#endif
+	active = true;
+	// Create a thread serving the connection
+	clientThread = std::jthread(clientThreadFunc, std::ref(*this));
+	// Mark the time at which the client was connected
+	connectionTime = std::chrono::system_clock::now();
+
+}
+
+ConnectionClient::ConnectionClient(unsigned int clientId, sockpp::tcp_socket sock, Reactor& reactor) : clientId(clientId), reactor(&reactor), sock(std::move(sock)) {
+	ip = this->sock.peer_address().to_string();
+	// the reactor thread is shared by many clients, so it must never block on a single socket
+	this->sock.set_non_blocking(true);
+	// requests are gathered into whole frames by the server, so the socket itself should not delay them
+	this->sock.set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+	// responses are framed from the byte stream, however it is split or merged by TCP
+	AMCOM_InitParser(&parser);
 	active = true;
 	// Mark the time at which the client was connected
 	connectionTime = std::chrono::system_clock::now();
+	std::osyncstream(std::cout) << "Got remote connection from " << ip << std::endl;
+	reactor.attach(*this);
+}
 
+ConnectionClient::~ConnectionClient() {
+	if (reactor) {
+		// make sure the reactor thread no longer touches this client
+		reactor->detach(*this);
+	}
+	if (clientThread.joinable()) {
+		// the connection thread is woken by the stop request and must be gone before the wakeup event is closed
+		clientThread.request_stop();
+		clientThread.join();
+	}
+#if defined(__linux__)
+	if (wakeFd >= 0) {
+		::close(wakeFd);
+	}
+#endif
 }
 
 bool ConnectionClient::runTransaction(ClientTransaction& transaction) {
-	if (active) {
+	{
+		// lock access to the clients transactions (RAII) - the client is closed under the same lock
+		const std::lock_guard<std::mutex> lock(transactionsMutex);
+		if (!active) {
+			return false;
+		}
 		transaction.state = SCHEDULED;
-		// lock access to the clients transactions (RAII)
+		transaction.scheduleTime = std::chrono::steady_clock::now();
+		requests.emplace_back(&transaction, nullptr, transaction.scheduleTime);
+	}
+	// wake the connection thread or the reactor, so the request is sent right away
+	wake();
+	return true;
+}
+
+bool ConnectionClient::send(std::shared_ptr<const std::vector<uint8_t>> packet) {
+	{
+		// lock access to the clients transactions (RAII) - the client is closed under the same lock
 		const std::lock_guard<std::mutex> lock(transactionsMutex);
-		transactions.push_back(transaction);
-		return true;
+		if (!active) {
+			return false;
+		}
+		requests.emplace_back(nullptr, std::move(packet), std::chrono::steady_clock::now());
 	}
-	return false;
+	// wake the connection thread or the reactor, so the packet is sent right away
+	wake();
+	return true;
+}
+
+void ConnectionClient::runHandshake(Handshake& handshake) {
+	this->handshake = &handshake;
+	handshakeTransaction = std::make_unique<ClientTransaction>(handshake.getHandshakeRequest(), handshake.getHandshakeResponseSize(), handshake.getHandshakeValidator(), nullptr, handshake.getHandshakeResponseType());
+	runTransaction(*handshakeTransaction);
+}
+
+bool ConnectionClient::isIdentified() const {
+	return handshakeTransaction && (DONE == handshakeTransaction->getState());
+}
+
+std::string ConnectionClient::getName() const {
+	if (isIdentified()) {
+		return handshake->getName(clientId);
+	}
+	return "???";
 }
 
 void ConnectionClient::notifyRtt(std::chrono::milliseconds rtt) {
@@ -34,6 +127,26 @@ void ConnectionClient::notifyRtt(std::chrono::milliseconds rtt) {
 	}
 }
 
+void ConnectionClient::notifyQueueDelay(std::chrono::time_point<std::chrono::steady_clock> scheduleTime) {
+	auto delay = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - scheduleTime);
+	// lock access to the queue delay log (RAII)
+	const std::lock_guard<std::mutex> lock(queueDelayMutex);
+	queueDelayLog.push_back(delay.count());
+	while (queueDelayLog.size() > 10) {
+		queueDelayLog.pop_front();
+	}
+}
+
+std::chrono::microseconds ConnectionClient::getQueueDelay() {
+	// lock access to the queue delay log (RAII)
+	const std::lock_guard<std::mutex> lock(queueDelayMutex);
+	if (queueDelayLog.size() > 0) {
+		uint64_t sum = std::accumulate(queueDelayLog.begin(), queueDelayLog.end(), uint64_t(0));
+		return std::chrono::microseconds(sum / queueDelayLog.size());
+	}
+	return std::chrono::microseconds(0);
+}
+
 std::chrono::milliseconds ConnectionClient::getRtt() const {
 
 	if (rttLog.size() > 0) {
@@ -61,88 +174,323 @@ std::chrono::milliseconds ConnectionClient::getDisconnectionTime() const {
 
 
 
-void ConnectionClient::clientThreadFunc(std::stop_token stop_token, ConnectionClient& client, sockpp::tcp_socket sock) {
+void ConnectionClient::clientThreadFunc(std::stop_token stop_token, ConnectionClient& client) {
 
 	// we will use blocking mode for socket read, but we must rely on timeouts
-    if (false == sock.read_timeout(std::chrono::milliseconds(500))) {
+    if (false == client.sock.read_timeout(responseTimeout)) {
     	std::osyncstream(std::cerr) << "Unable to work with timeout-less sockets. Aborting" << std::endl;
     	abort();
     }
 
-    std::osyncstream(std::cout) << "Got remote connection from " << sock.peer_address() << std::endl;
+    std::osyncstream(std::cout) << "Got remote connection from " << client.ip << std::endl;
 
+	bool connected = true;
+#if defined(__linux__)
+	// a stop request wakes the thread the same way a scheduled request does
+	std::stop_callback onStop(stop_token, [&client] { client.wake(); });
+	// we are using stop_token of std::jthread to check if stop was requested
+	while (connected && !stop_token.stop_requested()) {
+		// send whatever may be sent now
+		connected = client.pump();
+		if (!connected) {
+			break;
+		}
+		// wait for a response, but not past the deadline of the oldest one, and for newly scheduled requests at the same time
+		int timeout = -1;
+		if (!client.inFlight.empty()) {
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(client.deadline() - std::chrono::system_clock::now());
+			timeout = std::max<int>(0, remaining.count());
+		}
+		pollfd events[2] = {{client.sock.handle(), POLLIN, 0}, {client.wakeFd, POLLIN, 0}};
+		if (poll(events, 2, timeout) > 0) {
+			if (events[1].revents & POLLIN) {
+				// consume the wakeup event - the scheduled requests are sent by the next pump
+				uint64_t value;
+				[[maybe_unused]] auto result = read(client.wakeFd, &value, sizeof(value));
+			}
+			if (events[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+				connected = client.receive();
+			}
+		}
+		connected = connected && client.expire(std::chrono::system_clock::now());
+	}
+#else
 	// we are using stop_token of std::jthread to check if stop was requested
-	while (!stop_token.stop_requested()) {
-		// check, if there are some transactions waiting
-		// lock access to the transactions
-		client.transactionsMutex.lock();
-		if (false == client.transactions.empty()) {
-			ClientTransaction& transaction = client.transactions.front();
-			// remove this transaction from the queue
-			client.transactions.pop_front();
-			// unlock access to the transactions
-			client.transactionsMutex.unlock();
-
-			if (SCHEDULED == transaction.state) {
-				//std::osyncstream(std::cout) << "Running transaction with " << sock.peer_address() << ", sending " << transaction.request.size() << " bytes, expecting " << transaction.responseSize << std::endl;
-				// Mark request time for RTT calculation
-				transaction.requestTime = std::chrono::system_clock::now();
-				// Try to write data to socket
-				if (transaction.request.size() != sock.write_n(transaction.request.data(), transaction.request.size())) {
-					// we were unable to write data to socket - treat this as timeout
-					transaction.state = TIMEOUT;
-					// signal that the transaction is finished
-					transaction.endOfTransactionSignal.release();
-					// no data could be sent - this means that the socket was closed - we need to close the connection thread
-					client.clientThread.request_stop();
-				} else {
-					// Check if we need to wait for response
-					if (transaction.responseSize > 0) {
-						// we should wait for the response
-						transaction.state = WAITING;
-						if (transaction.responseSize == sock.read(transaction.responseBuf, transaction.responseSize)) {
-							// validate the response
-							if (true == transaction.validator(client.getClientId(), std::span<const uint8_t>(transaction.responseBuf, transaction.responseSize))) {
-								// response is valid
-								transaction.state = DONE;
-							} else {
-								// response is invalid
-								transaction.responseSize = 0;
-								transaction.state = TIMEOUT;
-								std::osyncstream(std::cout) << "Got invalid response from " << sock.peer_address() << std::endl;
-							}
-						} else {
-							transaction.state = TIMEOUT;
-						}
-						// Mark response time for RTT calculation
-						transaction.responseTime = std::chrono::system_clock::now();
-						// Calculate RTT and notify the client object about it
-						transaction.rtt = std::chrono::duration_cast<std::chrono::milliseconds>(transaction.responseTime - transaction.requestTime);
-						client.notifyRtt(transaction.rtt);
-						// signal that the transaction is finished
-						transaction.endOfTransactionSignal.release();
-						if (transaction.responseSize == 0) {
-							// no data could be read - this means that the socket was closed - we need to close the connection thread
-							client.clientThread.request_stop();
-						}
-					} else {
-						// there is no expected response - the transaction is done
-						transaction.state = DONE;
-						// signal that the transaction is finished
-						transaction.endOfTransactionSignal.release();
-					}
-				}
+	while (connected && !stop_token.stop_requested()) {
+		// send whatever may be sent now
+		connected = client.pump();
+		if (connected && !client.inFlight.empty()) {
+			// wait for the oldest response, but not past its deadline (the requests scheduled meanwhile wait for the read to return)
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(client.deadline() - std::chrono::system_clock::now());
+			if (remaining.count() > 0) {
+				client.sock.read_timeout(remaining);
+				connected = client.receive();
 			}
+			connected = connected && client.expire(std::chrono::system_clock::now());
+		} else if (connected) {
+			// sleep until a transaction is scheduled or stop is requested (the lock is released while waiting)
+			std::unique_lock<std::mutex> lock(client.transactionsMutex);
+			client.transactionsScheduled.wait(lock, stop_token, [&client] { return !client.requests.empty() && !client.corked; });
+		}
+	}
+#endif
+	client.close();
+}
+
+bool ConnectionClient::nextRequest(QueuedRequest& request) {
+	// lock access to the clients transactions (RAII)
+	const std::lock_guard<std::mutex> lock(transactionsMutex);
+	if (requests.empty()) {
+		return false;
+	}
+	request = std::move(requests.front());
+	requests.pop_front();
+	return true;
+}
+
+void ConnectionClient::finishTransaction(ClientTransaction& transaction, ConnectionTransactionState state) {
+	// Mark response time for RTT calculation
+	transaction.responseTime = std::chrono::system_clock::now();
+	// Calculate RTT and notify the client object about it
+	transaction.rtt = std::chrono::duration_cast<std::chrono::milliseconds>(transaction.responseTime - transaction.requestTime);
+	notifyRtt(transaction.rtt);
+	transaction.state = state;
+	signalFinished(transaction);
+}
+
+void ConnectionClient::signalFinished(ClientTransaction& transaction) {
+	// grab the latch first - once the latch is counted down the transaction may be destroyed by its waiter
+	CompletionLatch* latch = transaction.latch;
+	// signal that the transaction is finished
+	transaction.endOfTransactionSignal.release();
+	if (latch) {
+		latch->countDown();
+	}
+}
+
+static bool wouldBlock(int error) {
+#if defined(_WIN32)
+	return (error == WSAEWOULDBLOCK) || (error == WSAETIMEDOUT) || (error == WSAEINTR);
+#else
+	return (error == EAGAIN) || (error == EWOULDBLOCK) || (error == EINTR);
+#endif
+}
+
+void ConnectionClient::setPipelining(bool enabled) {
+	pipelined = enabled;
+}
+
+void ConnectionClient::cork() {
+	corked = true;
+}
+
+void ConnectionClient::uncork() {
+	corked = false;
+	// send everything that was held back
+	wake();
+}
+
+void ConnectionClient::wake() {
+	if (reactor) {
+		reactor->notify(*this);
+	} else {
+#if defined(__linux__)
+		// the event stays signalled until the connection thread consumes it, so the wakeup cannot be lost
+		uint64_t one = 1;
+		[[maybe_unused]] auto result = write(wakeFd, &one, sizeof(one));
+#else
+		// take the lock, so the notification cannot slip in between the connection thread checking the queue and going to sleep
+		{
+			const std::lock_guard<std::mutex> lock(transactionsMutex);
+		}
+		transactionsScheduled.notify_one();
+#endif
+	}
+}
+
+IoCounters ConnectionClient::getIoCounters() const {
+	return IoCounters{writeCalls, bytesWritten};
+}
+
+bool ConnectionClient::pump() {
+	// unless pipelining, nothing new is sent while a response is awaited, and nothing at all while corked
+	QueuedRequest request;
+	while (!corked && (pipelined || inFlight.empty()) && nextRequest(request)) {
+		notifyQueueDelay(request.scheduleTime);
+		if (request.packet) {
+			// a broadcast packet - it is shared with the other clients and needs no response
+			txBuffer.insert(txBuffer.end(), request.packet->begin(), request.packet->end());
+			request.packet.reset();
+			continue;
+		}
+		ClientTransaction* transaction = request.transaction;
+		if (SCHEDULED != transaction->state) {
+			continue;
+		}
+		// Mark request time for RTT calculation
+		transaction->requestTime = std::chrono::system_clock::now();
+		// the request is copied into the outgoing frame
+		txBuffer.insert(txBuffer.end(), transaction->request.begin(), transaction->request.end());
+		if (transaction->responseSize > 0) {
+			// responses arrive in the order of requests
+			transaction->state = WAITING;
+			inFlight.push_back(transaction);
 		} else {
-			// unlock access to the transactions
-			client.transactionsMutex.unlock();
-			Sleep(10);
+			// there is no expected response - the transaction is done once the frame is written
+			unflushed.push_back(transaction);
 		}
 	}
-	std::osyncstream(std::cout) << "Closing remote connection with " << sock.peer_address() << std::endl;
-	// Mark the time at which the client was connected
-	client.disconnectionTime = std::chrono::system_clock::now();
-	client.active = false;
+	return flush();
+}
+
+bool ConnectionClient::flush() {
+	// all the requests gathered since the last flush go out in a single write
+	while (txOffset < txBuffer.size()) {
+		ssize_t written = sock.write(txBuffer.data() + txOffset, txBuffer.size() - txOffset);
+		writeCalls++;
+		if (written < 0) {
+			// a full socket buffer is not an error - the reactor will resume once the socket is writable
+			return (nullptr != reactor) && wouldBlock(sock.last_error());
+		}
+		txOffset += written;
+		bytesWritten += written;
+	}
+	txBuffer.clear();
+	txOffset = 0;
+	// the requests without response are done now
+	for (auto transaction : unflushed) {
+		transaction->responseTime = std::chrono::system_clock::now();
+		transaction->state = DONE;
+		signalFinished(*transaction);
+	}
+	unflushed.clear();
+	return true;
+}
+
+bool ConnectionClient::receive() {
+	uint8_t chunk[2048];
+	// read whatever has arrived - it may hold a part of a packet, or many packets
+	ssize_t count = sock.read(chunk, sizeof(chunk));
+	if (count == 0) {
+		// the peer closed the connection
+		return false;
+	}
+	if (count < 0) {
+		return wouldBlock(sock.last_error());
+	}
+	// the whole chunk is parsed in place, only a packet split at its end is carried over by the parser
+	std::size_t offset = 0;
+	while (offset < static_cast<std::size_t>(count)) {
+		AMCOM_PacketView views[16];
+		std::size_t consumed;
+		std::size_t packets = AMCOM_Parse(&parser, chunk + offset, count - offset, views, std::size(views), &consumed);
+		for (std::size_t p = 0; p < packets; p++) {
+			if (false == dispatch(views[p])) {
+				return false;
+			}
+		}
+		offset += consumed;
+	}
+	// the next requests may go out now
+	return pump();
+}
+
+bool ConnectionClient::isStale(const AMCOM_PacketView& packet) {
+	const auto now = std::chrono::system_clock::now();
+	while (!staleResponses.empty()) {
+		const StaleResponse& stale = staleResponses.front();
+		if (now >= stale.expiry) {
+			// the client never answered the timed out request
+			staleResponses.pop_front();
+			continue;
+		}
+		if ((anyResponseType == stale.type) || (packet.type == stale.type)) {
+			// responses arrive in the order of requests, so this one answers the oldest timed out request
+			staleResponses.pop_front();
+			return true;
+		}
+		// a response of another type - the client skipped the timed out request
+		staleResponses.pop_front();
+	}
+	return false;
+}
+
+bool ConnectionClient::dispatch(const AMCOM_PacketView& packet) {
+	// a late response to a timed out request must not be taken for the response to the next request.
+	// Responses of the same type carry no sequence number, so a client that skips a timed out request and answers the next one
+	// of the same type loses that answer too - and keeps the requests after it matched in order.
+	if (isStale(packet)) {
+		return true;
+	}
+	if (inFlight.empty()) {
+		// nobody waits for this packet - drop it
+		return true;
+	}
+	// responses arrive in the order of requests
+	ClientTransaction& transaction = *inFlight.front();
+	inFlight.pop_front();
+	// validate the response - a response that is too long or of an unexpected type is rejected here
+	const bool expectedType = (anyResponseType == transaction.responseType) || (packet.type == transaction.responseType);
+	if (packet.crcValid && expectedType && (packet.packetSize <= transaction.responseSize) && transaction.validator(clientId, std::span<const uint8_t>(packet.packet, packet.packetSize))) {
+		// only the accepted response is copied, so it outlives the receive buffer
+		std::memcpy(transaction.responseBuf, packet.packet, packet.packetSize);
+		transaction.responseSize = packet.packetSize;
+		finishTransaction(transaction, DONE);
+		return true;
+	}
+	transaction.responseSize = 0;
+	finishTransaction(transaction, INVALID);
+	std::osyncstream(std::cout) << "Got invalid response from " << ip << std::endl;
+	return false;
+}
+
+bool ConnectionClient::expire(std::chrono::time_point<std::chrono::system_clock> now) {
+	bool expired = false;
+	while (!inFlight.empty() && (now >= deadline())) {
+		ClientTransaction& transaction = *inFlight.front();
+		inFlight.pop_front();
+		// the response may still arrive - it is dropped when it does, for as long again as the client was given to respond
+		staleResponses.push_back({transaction.responseType, now + responseTimeout});
+		finishTransaction(transaction, TIMEOUT);
+		expired = true;
+	}
+	// a timeout alone does not close the connection
+	return expired ? pump() : true;
+}
+
+std::chrono::time_point<std::chrono::system_clock> ConnectionClient::deadline() const {
+	if (!inFlight.empty()) {
+		return inFlight.front()->requestTime + responseTimeout;
+	}
+	return std::chrono::time_point<std::chrono::system_clock>::max();
+}
+
+void ConnectionClient::close() {
+	// nothing more will arrive for the requests in flight
+	while (!inFlight.empty()) {
+		ClientTransaction& transaction = *inFlight.front();
+		inFlight.pop_front();
+		finishTransaction(transaction, TIMEOUT);
+	}
+	// and the frame will not be written anymore
+	for (auto transaction : unflushed) {
+		transaction->abandon();
+	}
+	unflushed.clear();
+	std::osyncstream(std::cout) << "Closing remote connection with " << ip << std::endl;
+	sock.shutdown();
+	// Mark the time at which the client was disconnected
+	disconnectionTime = std::chrono::system_clock::now();
+	// lock access to the clients transactions (RAII)
+	const std::lock_guard<std::mutex> lock(transactionsMutex);
+	active = false;
+	// the requests that were not sent yet never will be
+	for (auto& request : requests) {
+		if (request.transaction) {
+			request.transaction->abandon();
+		}
+	}
+	requests.clear();
 }
 
 
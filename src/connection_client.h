@@ -1,22 +1,32 @@
 #ifndef CONNECTION_CLIENT_H_
 #define CONNECTION_CLIENT_H_
 
+#include "amcom.h"
 #include "sockpp/tcp_socket.h"
+#include <atomic>
 #include <thread>
 #include <deque>
 #include <queue>
 #include <span>
 #include <semaphore>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace connection {
 
+class Reactor;
+
 enum ConnectionTransactionState{
 	IDLE = 0,
 	SCHEDULED,
 	WAITING,
 	DONE,
-	TIMEOUT
+	TIMEOUT,
+	INVALID
 };
 
 class TransactionResponseValidator {
@@ -33,17 +43,118 @@ public:
 
 static DefaultTransactionResponseValidator defaultTransactionResponseValidator;
 
+/// Expected response type of a transaction that accepts a response of any AMCOM packet type
+constexpr int anyResponseType = -1;
+
+/**
+ * Describes a handshake (request-response) run asynchronously with each newly accepted client, e.g. to identify it.
+ */
+class Handshake {
+public:
+	/// Request sent to the client
+	virtual std::span<const uint8_t> getHandshakeRequest() = 0;
+	/// Maximum size (in bytes) of the response
+	virtual std::size_t getHandshakeResponseSize() = 0;
+	/// Validator used to validate the response
+	virtual TransactionResponseValidator& getHandshakeValidator() = 0;
+	/// AMCOM packet type of the response (anyResponseType if any type is accepted)
+	virtual int getHandshakeResponseType() { return anyResponseType; }
+	/// Name of the client, available once the response was accepted by the validator
+	virtual std::string getName(unsigned int clientId) = 0;
+	/// Drops what is known about a client that was removed from the server
+	virtual void forget(unsigned int clientId) { ; }
+	virtual ~Handshake() { ; }
+};
+
+/**
+ * Gets told when a transaction has finished, e.g. to wake whoever runs the game instead of having it poll the transaction.
+ */
+class CompletionListener {
+public:
+	/// Called once all the client transactions of a transaction are finished - on the thread that finished the last one, so it must be short
+	virtual void transactionFinished() = 0;
+	virtual ~CompletionListener() { ; }
+};
+
+/**
+ * Counts down the finished client transactions of a transaction and wakes the waiter once all of them are finished.
+ */
+class CompletionLatch {
+public:
+	/**
+	 * Sets the listener told once all the client transactions are finished (nullptr - nobody is told).
+	 */
+	void setListener(CompletionListener* completionListener) {
+		const std::lock_guard<std::mutex> lock(mutex);
+		listener = completionListener;
+	}
+
+	/**
+	 * Rearms the latch for the given number of client transactions.
+	 */
+	void reset(std::size_t count) {
+		const std::lock_guard<std::mutex> lock(mutex);
+		pending = count;
+	}
+
+	/**
+	 * Marks one client transaction as finished.
+	 */
+	void countDown() {
+		// notify while holding the lock, so the waiter cannot destroy the latch before this call returns
+		const std::lock_guard<std::mutex> lock(mutex);
+		if (pending > 0) {
+			pending--;
+			// the listener is told under the lock as well, so it is not told anymore once isFinished() returned true
+			if ((pending == 0) && listener) {
+				listener->transactionFinished();
+			}
+		}
+		if (pending == 0) {
+			allFinished.notify_all();
+		}
+	}
+
+	/**
+	 * Returns true if all the client transactions are finished.
+	 */
+	bool isFinished() {
+		const std::lock_guard<std::mutex> lock(mutex);
+		return pending == 0;
+	}
+
+	/**
+	 * Waits until all the client transactions are finished, but at most until absTime.
+	 * @retval true if all the client transactions have finished
+	 */
+	template<class Clock, class Duration>
+	bool waitUntil(const std::chrono::time_point<Clock, Duration>& absTime) {
+		std::unique_lock<std::mutex> lock(mutex);
+		return allFinished.wait_until(lock, absTime, [this] { return pending == 0; });
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable allFinished;
+	std::size_t pending{0};
+	CompletionListener* listener{nullptr};
+};
+
 /** Represents a single transaction (request-response) with a single remote client */
 class ClientTransaction {
 	friend class ConnectionClient;
+	friend class Transaction;
 public:
 	/**
 	 * Constructs a transaction.
 	 *
 	 * @param[in] requestData data to be sent as a request
-	 * @param[in] expectedResponseSize expected size (in bytes) of the response. If set to 0, the transaction will not wait for the response
+	 * @param[in] expectedResponseSize maximum size (in bytes) of the response - shorter responses are left to the validator. If set to 0, the transaction will not wait for the response
+	 * @param[in] responseValidator response validation object used to validate the response
+	 * @param[in] completionLatch latch counted down when the transaction finishes (optional)
+	 * @param[in] expectedResponseType AMCOM packet type of the response - a response of another type is invalid
 	 */
-	ClientTransaction (std::span<const uint8_t> requestData, std::size_t expectedResponseSize = 0, TransactionResponseValidator& responseValidator = defaultTransactionResponseValidator) : request(requestData), responseSize(expectedResponseSize), response({responseBuf, responseSize}), validator(responseValidator) {
+	ClientTransaction (std::span<const uint8_t> requestData, std::size_t expectedResponseSize = 0, TransactionResponseValidator& responseValidator = defaultTransactionResponseValidator, CompletionLatch* completionLatch = nullptr, int expectedResponseType = anyResponseType) : request(requestData), responseSize(expectedResponseSize), responseType(expectedResponseType), response({responseBuf, responseSize}), validator(responseValidator), latch(completionLatch) {
 		;
 	}
 
@@ -63,6 +174,34 @@ public:
 		return false;
 	}
 
+	/**
+	 * Gets the transaction state.
+	 */
+	ConnectionTransactionState getState() const { return state; }
+
+	/**
+	 * Gets the time from sending the request to finishing the transaction, or the time elapsed since scheduling it if it is still running.
+	 */
+	std::chrono::microseconds getLatency() const {
+		if ((DONE == state) || (TIMEOUT == state) || (INVALID == state)) {
+			return std::chrono::duration_cast<std::chrono::microseconds>(responseTime - requestTime);
+		}
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - scheduleTime);
+	}
+
+	/**
+	 * Marks the transaction as finished without running it (e.g. because the client is gone).
+	 */
+	void abandon() {
+		CompletionLatch* completionLatch = latch;
+		requestTime = responseTime = std::chrono::system_clock::now();
+		state = TIMEOUT;
+		endOfTransactionSignal.release();
+		if (completionLatch) {
+			completionLatch->countDown();
+		}
+	}
+
 	/**
 	 * Gets the response to the request.
 	 * @return response data
@@ -78,20 +217,38 @@ public:
 
 
 private:
+	/**
+	 * Prepares a finished (or never run) transaction to be run again, without reallocating it.
+	 */
+	void rearm(std::span<const uint8_t> requestData, std::size_t expectedResponseSize) {
+		request = requestData;
+		responseSize = expectedResponseSize;
+		response = {responseBuf, responseSize};
+		// the end of the previous run may not have been waited for
+		(void)endOfTransactionSignal.try_acquire();
+		state = IDLE;
+	}
+
 	/// place to store the response
 	uint8_t responseBuf[512];
-	/// transaction state
-	volatile ConnectionTransactionState state{IDLE};
+	/// transaction state (set last, so the response may be read once the state is DONE - even while a late response arrives)
+	std::atomic<ConnectionTransactionState> state{IDLE};
 	/// request data
 	std::span<const uint8_t> request;
 	/// response size
 	std::size_t responseSize;
+	/// expected AMCOM packet type of the response
+	int responseType;
 	/// response data
 	std::span<const uint8_t> response;
 	/// response validator
 	TransactionResponseValidator& validator;
 	/// semaphore used to signal the end of transaction
 	std::binary_semaphore endOfTransactionSignal{0};
+	/// latch of the whole transaction, counted down when this client transaction finishes
+	CompletionLatch* latch;
+	/// time at which request was scheduled
+	std::chrono::time_point<std::chrono::steady_clock> scheduleTime;
 	/// time at which request was sent
 	std::chrono::time_point<std::chrono::system_clock> requestTime;
 	/// time at which response was received
@@ -100,36 +257,167 @@ private:
 	std::chrono::milliseconds rtt;
 };
 
+/** Entry of the client request queue: either a transaction, or a broadcast packet that needs no response */
+struct QueuedRequest {
+	/// Transaction to run (nullptr for a broadcast packet)
+	ClientTransaction* transaction;
+	/// Broadcast packet, shared by all the clients it is sent to
+	std::shared_ptr<const std::vector<uint8_t>> packet;
+	/// Time at which the request was scheduled
+	std::chrono::time_point<std::chrono::steady_clock> scheduleTime;
+};
+
+/** Response still owed by the client for a request that has timed out */
+struct StaleResponse {
+	/// Expected AMCOM packet type of the response
+	int type;
+	/// Time after which the response is no longer expected
+	std::chrono::time_point<std::chrono::system_clock> expiry;
+};
+
+/** Outgoing traffic counters of a client */
+struct IoCounters {
+	/// Number of socket write calls
+	uint64_t writeCalls;
+	/// Number of bytes written
+	uint64_t bytesWritten;
+};
+
 class ConnectionClient {
+	friend class Reactor;
 public:
+	/// Time the client is given to respond to a request
+	static constexpr std::chrono::milliseconds responseTimeout{500};
+
+	/**
+	 * Constructs a client served by its own connection thread.
+	 */
 	ConnectionClient(unsigned int clientId, sockpp::tcp_socket sock);
+	/**
+	 * Constructs a client served by the given reactor, which multiplexes it with other clients on a single thread.
+	 */
+	ConnectionClient(unsigned int clientId, sockpp::tcp_socket sock, Reactor& reactor);
+	~ConnectionClient();
 	bool isActive(void) const { return active; }
 	bool runTransaction(ClientTransaction& transaction);
+	/**
+	 * Schedules a packet that needs no response. The packet is shared, so it may be sent to many clients without copying.
+	 */
+	bool send(std::shared_ptr<const std::vector<uint8_t>> packet);
 	unsigned int getClientId() const { return clientId; }
 	std::string getIP() const { return ip; }
 	std::chrono::milliseconds  getRtt() const;
 	std::chrono::milliseconds getConnectionTime() const ;
 	std::chrono::milliseconds getDisconnectionTime() const ;
 	void notifyRtt(std::chrono::milliseconds rtt);
+	/**
+	 * Enables or disables pipelining. When pipelining, all scheduled requests are sent without waiting for the responses
+	 * to the previous ones, and the responses are matched to the requests in order.
+	 */
+	void setPipelining(bool enabled);
+	/**
+	 * Holds back scheduled requests until uncork is called. All the requests scheduled in between are then gathered
+	 * into a single frame and sent with a single write.
+	 */
+	void cork();
+	/**
+	 * Sends all the requests held back since cork.
+	 */
+	void uncork();
+	/**
+	 * Gets the outgoing traffic counters.
+	 */
+	IoCounters getIoCounters() const;
+	/**
+	 * Starts the handshake with the client. The handshake runs in the background, before any other transaction.
+	 */
+	void runHandshake(Handshake& handshake);
+	/**
+	 * Returns true if the handshake has finished successfully.
+	 */
+	bool isIdentified() const;
+	/**
+	 * Gets the client name obtained by the handshake, "???" if the client was not identified.
+	 */
+	std::string getName() const;
+	/**
+	 * Gets the mean time between scheduling a request and handing it to the socket.
+	 */
+	std::chrono::microseconds getQueueDelay();
 private:
 	unsigned int clientId;
 	/// Client connection state
 	bool active;
 	/// Client IP
 	std::string ip;
-	/// Connection thread
-	std::jthread clientThread;
-	/// Queue of transactions
-	std::deque<std::reference_wrapper<ClientTransaction>> transactions;
-	/// Mutex guarding access to transactions
+	/// Queue of requests
+	std::deque<QueuedRequest> requests;
+	/// Mutex guarding access to requests
 	std::mutex transactionsMutex;
+	/// Signalled when a transaction is scheduled, wakes the connection thread
+	std::condition_variable_any transactionsScheduled;
 	/// Mean RTT (round trip time)
 	std::deque<unsigned int> rttLog;
+	/// Recent delays (in us) between scheduling and sending a request
+	std::deque<uint64_t> queueDelayLog;
+	/// Mutex guarding access to queueDelayLog
+	std::mutex queueDelayMutex;
 	/// Time at which the client was connected
 	std::chrono::time_point<std::chrono::system_clock> connectionTime;
 	/// Time at which the client was disconnected
 	std::chrono::time_point<std::chrono::system_clock> disconnectionTime;
-	static void clientThreadFunc(std::stop_token stop_token, ConnectionClient& client, sockpp::tcp_socket sock);
+	/// Handshake run with the client (nullptr if none)
+	Handshake* handshake{nullptr};
+	/// Transaction of the handshake
+	std::unique_ptr<ClientTransaction> handshakeTransaction;
+	/// Reactor serving this client (nullptr if the client runs its own connection thread)
+	Reactor* reactor{nullptr};
+	/// Client socket
+	sockpp::tcp_socket sock;
+	/// True if requests are sent without waiting for the previous responses
+	std::atomic<bool> pipelined{false};
+	/// True if scheduled requests are held back
+	std::atomic<bool> corked{false};
+	/// Number of socket write calls
+	std::atomic<uint64_t> writeCalls{0};
+	/// Number of bytes written
+	std::atomic<uint64_t> bytesWritten{0};
+	/// Transactions awaiting their responses, oldest first
+	std::deque<ClientTransaction*> inFlight;
+	/// Responses to the timed out requests that may still arrive (ahead of the responses to the requests in flight), oldest first
+	std::deque<StaleResponse> staleResponses;
+	/// Transactions without response that are done once the outgoing frame is written
+	std::vector<ClientTransaction*> unflushed;
+	/// Parser framing the responses from the incoming byte stream
+	AMCOM_Parser parser;
+	/// Outgoing frame - request bytes not yet accepted by the socket
+	std::vector<uint8_t> txBuffer;
+	/// Number of bytes from txBuffer already written
+	std::size_t txOffset{0};
+	/// True if the reactor watches the socket for writability (reactor only)
+	bool watchingWrite{false};
+	/// eventfd descriptor used to wake the connection thread (connection thread on Linux only)
+	int wakeFd{-1};
+	/// Connection thread (declared last, so it is joined before the state it uses is destroyed)
+	std::jthread clientThread;
+
+	static void clientThreadFunc(std::stop_token stop_token, ConnectionClient& client);
+
+	void notifyQueueDelay(std::chrono::time_point<std::chrono::steady_clock> scheduleTime);
+	void wake();
+	bool nextRequest(QueuedRequest& request);
+	void finishTransaction(ClientTransaction& transaction, ConnectionTransactionState state);
+	static void signalFinished(ClientTransaction& transaction);
+	bool pump();
+	bool flush();
+	bool receive();
+	/// Returns true if the packet is a late response to a timed out request, which is dropped
+	bool isStale(const AMCOM_PacketView& packet);
+	/// Hands a packet framed by the parser to the oldest transaction in flight. Returns false if the response is invalid.
+	bool dispatch(const AMCOM_PacketView& packet);
+	bool expire(std::chrono::time_point<std::chrono::system_clock> now);
+	std::chrono::time_point<std::chrono::system_clock> deadline() const;
+	void close();
 };
 
 }
@@ -0,0 +1,34 @@
+#include "connection_deadline_policy.h"
+
+#include <algorithm>
+
+namespace connection {
+
+    DeadlinePolicy::DeadlinePolicy(double percentile, std::chrono::microseconds margin, std::chrono::microseconds minDeadline, std::chrono::microseconds maxDeadline, size_t windowSize) :
+        percentile(percentile), margin(margin), minDeadline(minDeadline), maxDeadline(maxDeadline), samples(windowSize) {
+        window.reserve(windowSize);
+    }
+
+    void DeadlinePolicy::record(std::chrono::microseconds latency) {
+        samples[next] = latency.count();
+        next          = (next + 1) % samples.size();
+        count         = std::min(count + 1, samples.size());
+    }
+
+    void DeadlinePolicy::recordTimeout() {
+        record(deadline());
+    }
+
+    std::chrono::microseconds DeadlinePolicy::deadline() const {
+        if (count < minSamples) {
+            return maxDeadline;
+        }
+        // select the percentile without sorting the whole window
+        window.assign(samples.begin(), samples.begin() + count);
+        auto nth = window.begin() + static_cast<size_t>(percentile * (count - 1));
+        std::nth_element(window.begin(), nth, window.end());
+
+        return std::clamp(std::chrono::microseconds(*nth) + margin, minDeadline, maxDeadline);
+    }
+
+} // namespace connection
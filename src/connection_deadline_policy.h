@@ -0,0 +1,69 @@
+#ifndef CONNECTION_DEADLINE_POLICY_H_
+#define CONNECTION_DEADLINE_POLICY_H_
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace connection {
+
+    /**
+     * Derives a response deadline from the observed distribution of response latencies.
+     *
+     * The deadline is the given percentile of the recent latencies plus a safety margin, clamped to [minDeadline, maxDeadline].
+     * Until enough samples are collected the policy returns maxDeadline.
+     */
+    class DeadlinePolicy {
+      public:
+        /**
+         * Constructs a deadline policy.
+         *
+         * @param[in] percentile percentile of the latency distribution the deadline is based on (0..1)
+         * @param[in] margin safety margin added to the percentile
+         * @param[in] minDeadline lower bound of the deadline
+         * @param[in] maxDeadline upper bound of the deadline
+         * @param[in] windowSize number of most recent latency samples taken into account
+         */
+        DeadlinePolicy(double                    percentile  = 0.99,
+                       std::chrono::microseconds margin      = std::chrono::milliseconds(5),
+                       std::chrono::microseconds minDeadline = std::chrono::milliseconds(10),
+                       std::chrono::microseconds maxDeadline = std::chrono::milliseconds(500),
+                       size_t                    windowSize  = 512);
+
+        /**
+         * Records the latency of a single response.
+         */
+        void record(std::chrono::microseconds latency);
+
+        /**
+         * Records a response that did not arrive in time. Its latency is unknown but not below the current deadline, so the deadline is
+         * recorded in its place (a censored sample) - otherwise the lost responses would drag the deadline down.
+         */
+        void recordTimeout();
+
+        /**
+         * Returns the current deadline.
+         */
+        std::chrono::microseconds deadline() const;
+
+      private:
+        /// Minimum number of samples needed before the percentile is trusted
+        constexpr static size_t minSamples = 16;
+
+        double                    percentile;
+        std::chrono::microseconds margin;
+        std::chrono::microseconds minDeadline;
+        std::chrono::microseconds maxDeadline;
+        /// Ring buffer of latency samples (in us)
+        std::vector<int64_t> samples;
+        /// Position in samples where the next sample is stored
+        size_t next{0};
+        /// Number of valid samples
+        size_t count{0};
+        /// Copy of the window the percentile is selected in, allocated once
+        mutable std::vector<int64_t> window;
+    };
+
+} // namespace connection
+
+#endif /* CONNECTION_DEADLINE_POLICY_H_ */
@@ -0,0 +1,205 @@
+#include "connection_reactor.h"
+
+#include <algorithm>
+#include <iostream>
+#include <syncstream>
+#include <vector>
+
+#if defined(__linux__)
+#    include <sys/epoll.h>
+#    include <sys/eventfd.h>
+#    include <unistd.h>
+#endif
+
+namespace connection {
+
+#if defined(__linux__)
+
+    Reactor::Reactor() {
+        pollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ((pollFd < 0) || (wakeFd < 0)) {
+            std::osyncstream(std::cerr) << "Unable to create reactor. Aborting" << std::endl;
+            abort();
+        }
+        // the wakeup event is registered with no client attached
+        epoll_event event{};
+        event.events   = EPOLLIN;
+        event.data.ptr = nullptr;
+        epoll_ctl(pollFd, EPOLL_CTL_ADD, wakeFd, &event);
+        // run the reactor thread
+        reactorThread = std::jthread(reactorThreadFunc, std::ref(*this));
+    }
+
+    Reactor::~Reactor() {
+        reactorThread.request_stop();
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write(wakeFd, &one, sizeof(one));
+        reactorThread.join();
+        ::close(wakeFd);
+        ::close(pollFd);
+    }
+
+    bool Reactor::isSupported() {
+        return true;
+    }
+
+    void Reactor::attach(ConnectionClient& client) {
+        // lock access to the clients (RAII)
+        const std::lock_guard<std::mutex> lock(mutex);
+
+        epoll_event event{};
+        event.events   = EPOLLIN;
+        event.data.ptr = &client;
+        epoll_ctl(pollFd, EPOLL_CTL_ADD, client.sock.handle(), &event);
+        clients.insert(&client);
+    }
+
+    void Reactor::detach(ConnectionClient& client) {
+        // lock access to the clients (RAII) - the reactor thread holds this lock while it works with any client
+        const std::lock_guard<std::mutex> lock(mutex);
+
+        if (clients.erase(&client)) {
+            epoll_ctl(pollFd, EPOLL_CTL_DEL, client.sock.handle(), nullptr);
+        }
+        notified.erase(&client);
+    }
+
+    void Reactor::notify(ConnectionClient& client) {
+        {
+            // lock access to the clients (RAII)
+            const std::lock_guard<std::mutex> lock(mutex);
+            notified.insert(&client);
+        }
+        uint64_t one = 1;
+        [[maybe_unused]] auto result = write(wakeFd, &one, sizeof(one));
+    }
+
+    void Reactor::watch(ConnectionClient& client, bool write) {
+        if (client.watchingWrite != write) {
+            epoll_event event{};
+            event.events   = write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            event.data.ptr = &client;
+            epoll_ctl(pollFd, EPOLL_CTL_MOD, client.sock.handle(), &event);
+            client.watchingWrite = write;
+        }
+    }
+
+    void Reactor::drop(ConnectionClient& client) {
+        epoll_ctl(pollFd, EPOLL_CTL_DEL, client.sock.handle(), nullptr);
+        clients.erase(&client);
+        notified.erase(&client);
+        client.close();
+    }
+
+    void Reactor::reactorThreadFunc(std::stop_token stop_token, Reactor& reactor) {
+        constexpr int maxEvents = 64;
+        epoll_event   events[maxEvents];
+
+        std::osyncstream(std::cout) << "Reactor thread started" << std::endl;
+
+        while (!stop_token.stop_requested()) {
+            // sleep until the earliest response deadline, or until something happens
+            int timeout = -1;
+            {
+                const std::lock_guard<std::mutex> lock(reactor.mutex);
+                auto                              deadline = std::chrono::time_point<std::chrono::system_clock>::max();
+                for (auto client : reactor.clients) {
+                    deadline = std::min(deadline, client->deadline());
+                }
+                if (deadline != std::chrono::time_point<std::chrono::system_clock>::max()) {
+                    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::system_clock::now());
+                    timeout        = std::max<int>(0, remaining.count());
+                }
+            }
+
+            int count = epoll_wait(reactor.pollFd, events, maxEvents, timeout);
+
+            // lock access to the clients (RAII)
+            const std::lock_guard<std::mutex> lock(reactor.mutex);
+
+            std::vector<ConnectionClient*> broken;
+            for (int e = 0; e < count; e++) {
+                auto client = reinterpret_cast<ConnectionClient*>(events[e].data.ptr);
+                if (nullptr == client) {
+                    // consume the wakeup event - notified clients are handled below
+                    uint64_t value;
+                    [[maybe_unused]] auto result = read(reactor.wakeFd, &value, sizeof(value));
+                    continue;
+                }
+                // the client may have been detached after epoll_wait returned
+                if (false == reactor.clients.contains(client)) {
+                    continue;
+                }
+                bool ok = true;
+                if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    ok = client->receive();
+                }
+                if (ok && (events[e].events & EPOLLOUT)) {
+                    ok = client->flush();
+                }
+                if (ok) {
+                    reactor.watch(*client, client->txOffset < client->txBuffer.size());
+                } else {
+                    broken.push_back(client);
+                }
+            }
+
+            // send the requests of the clients that got new transactions
+            for (auto client : reactor.notified) {
+                if (reactor.clients.contains(client)) {
+                    if (client->pump()) {
+                        reactor.watch(*client, client->txOffset < client->txBuffer.size());
+                    } else {
+                        broken.push_back(client);
+                    }
+                }
+            }
+            reactor.notified.clear();
+
+            // time out the responses that did not arrive
+            const auto now = std::chrono::system_clock::now();
+            for (auto client : reactor.clients) {
+                if (false == client->expire(now)) {
+                    broken.push_back(client);
+                }
+            }
+
+            for (auto client : broken) {
+                if (reactor.clients.contains(client)) {
+                    reactor.drop(*client);
+                }
+            }
+        }
+    }
+
+#else
+
+    // The reactor backend relies on epoll. Elsewhere the server falls back to a connection thread per client.
+
+    Reactor::Reactor() {}
+
+    Reactor::~Reactor() {}
+
+    bool Reactor::isSupported() {
+        return false;
+    }
+
+    void Reactor::attach(ConnectionClient& client) {
+        std::osyncstream(std::cerr) << "Reactor backend is not supported on this platform. Aborting" << std::endl;
+        abort();
+    }
+
+    void Reactor::detach(ConnectionClient& client) {}
+
+    void Reactor::notify(ConnectionClient& client) {}
+
+    void Reactor::watch(ConnectionClient& client, bool write) {}
+
+    void Reactor::drop(ConnectionClient& client) {}
+
+    void Reactor::reactorThreadFunc(std::stop_token stop_token, Reactor& reactor) {}
+
+#endif
+
+} // namespace connection
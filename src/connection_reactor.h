@@ -0,0 +1,71 @@
+#ifndef CONNECTION_REACTOR_H_
+#define CONNECTION_REACTOR_H_
+
+#include "connection_client.h"
+
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace connection {
+
+    /**
+     * Event-driven backend that serves many clients from a single thread.
+     *
+     * Instead of running a connection thread per client, the reactor waits (epoll) on the sockets of all attached clients
+     * and on a wakeup event signalled whenever a transaction is scheduled. Requests go out as soon as they are scheduled,
+     * responses are collected as soon as they arrive and pending responses are timed out by the same thread.
+     */
+    class Reactor {
+      public:
+        /**
+         * Constructs a reactor and starts its thread.
+         */
+        Reactor();
+        ~Reactor();
+
+        Reactor(Reactor const&)            = delete;
+        Reactor& operator=(Reactor const&) = delete;
+
+        /**
+         * Returns true if the reactor backend is available on this platform.
+         */
+        static bool isSupported();
+
+        /**
+         * Starts serving the given client.
+         */
+        void attach(ConnectionClient& client);
+
+        /**
+         * Stops serving the given client. After this call returns the reactor no longer touches the client.
+         */
+        void detach(ConnectionClient& client);
+
+        /**
+         * Notifies the reactor that the given client has new transactions scheduled.
+         */
+        void notify(ConnectionClient& client);
+
+      private:
+        /// Guards access to clients and notified
+        std::mutex mutex;
+        /// Clients served by this reactor
+        std::set<ConnectionClient*> clients;
+        /// Clients with newly scheduled transactions
+        std::set<ConnectionClient*> notified;
+        /// epoll instance descriptor
+        int pollFd{-1};
+        /// eventfd descriptor used to wake the reactor thread
+        int wakeFd{-1};
+        /// Reactor thread (declared last, so it is joined before the state it uses is destroyed)
+        std::jthread reactorThread;
+
+        void watch(ConnectionClient& client, bool write);
+        void drop(ConnectionClient& client);
+        static void reactorThreadFunc(std::stop_token stop_token, Reactor& reactor);
+    };
+
+} // namespace connection
+
+#endif /* CONNECTION_REACTOR_H_ */
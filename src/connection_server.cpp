@@ -6,9 +6,19 @@
 
 namespace connection {
 
-    Server::Server(uint16_t listenPortNo, size_t clientLimit) : isAccepting(true), clientLimit(clientLimit) {
+    Server::Server(uint16_t listenPortNo, size_t clientLimit, size_t reactorCount, Handshake* handshake) : isAccepting(true), clientLimit(clientLimit), handshake(handshake) {
         // initialize sockpp library
         sockpp::initialize();
+        // start the reactors, if requested and available
+        if (reactorCount > 0) {
+            if (Reactor::isSupported()) {
+                for (size_t r = 0; r < reactorCount; r++) {
+                    reactors.push_back(std::make_unique<Reactor>());
+                }
+            } else {
+                std::osyncstream(std::cerr) << "Reactor backend not supported, using a connection thread per client" << std::endl;
+            }
+        }
         // run the server thread
         serverThread = std::thread(serverThreadFunc, this, listenPortNo);
         serverThread.detach();
@@ -24,14 +34,45 @@ namespace connection {
         for (auto& client : clients) {
             // schedule transactions with active clients only
             if (client.second.isActive()) {
-                // construct individual client transaction
-                auto clientTransaction = transaction.clientTransactions.try_emplace(client.first, transaction.request, transaction.responseSize, transaction.validator);
-                // and run it (clientTransaction is an std::pair<iterator, bool>)
-                client.second.runTransaction(clientTransaction.first->second);
+                // set up individual client transaction
+                transaction.addClient(client.first);
+            }
+        }
+        // arm the latch before any of the client transactions may finish
+        transaction.completion.reset(transaction.runningCount);
+        for (auto& client : transaction.running()) {
+            // and run it
+            if (false == clients.at(client.clientId).runTransaction(*client.transaction)) {
+                // the client is gone in the meantime
+                client.transaction->abandon();
             }
         }
     }
 
+    void Server::runTransaction(Transaction& transaction, std::span<const unsigned int> clientIds) {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        // reset the transaction
+        transaction.reset();
+
+        for (auto clientId : clientIds) {
+            // schedule transactions with active clients only
+            if (auto client = clients.find(clientId); (client != clients.end()) && client->second.isActive()) {
+                // set up individual client transaction
+                transaction.addClient(clientId);
+            }
+        }
+        // arm the latch before any of the client transactions may finish
+        transaction.completion.reset(transaction.runningCount);
+        for (auto& client : transaction.running()) {
+            // and run it
+            if (false == clients.at(client.clientId).runTransaction(*client.transaction)) {
+                // the client is gone in the meantime
+                client.transaction->abandon();
+            }
+        }
+    }
 
     void Server::runTransactionWithSingleClient(unsigned int clientId, Transaction& transaction) {
         // lock access to the clients list (RAII)
@@ -39,14 +80,49 @@ namespace connection {
 
         // reset the transaction
         transaction.reset();
+        transaction.completion.reset(0);
 
-        // find client
-        auto& client = clients.at(clientId);
+        // find client - it may have been removed in the meantime
+        auto found = clients.find(clientId);
+        if (found == clients.end()) {
+            return;
+        }
+        auto& client = found->second;
         if (client.isActive()) {
-            // construct individual client transaction
-            auto clientTransaction = transaction.clientTransactions.try_emplace(client.getClientId(), transaction.request, transaction.responseSize, transaction.validator);
-            // and run it (clientTransaction is an std::pair<iterator, bool>)
-            client.runTransaction(clientTransaction.first->second);
+            // set up individual client transaction
+            auto& clientTransaction = transaction.addClient(client.getClientId());
+            transaction.completion.reset(1);
+            // and run it
+            if (false == client.runTransaction(clientTransaction)) {
+                clientTransaction.abandon();
+            }
+        }
+    }
+
+    void Server::broadcast(std::span<const uint8_t> packet) {
+        auto shared = std::make_shared<const std::vector<uint8_t>>(packet.begin(), packet.end());
+
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        for (auto& client : clients) {
+            client.second.send(shared);
+        }
+    }
+
+    void Server::broadcast(std::span<const uint8_t> packet, std::span<const unsigned int> clientIds) {
+        if (clientIds.empty()) {
+            return;
+        }
+        auto shared = std::make_shared<const std::vector<uint8_t>>(packet.begin(), packet.end());
+
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        for (auto clientId : clientIds) {
+            if (auto client = clients.find(clientId); client != clients.end()) {
+                client->second.send(shared);
+            }
         }
     }
 
@@ -54,8 +130,17 @@ namespace connection {
         // lock access to the clients list (RAII)
         const std::lock_guard<std::mutex> lock(clientsMutex);
 
+        // Keep the traffic counters of the client
+        if (auto client = clients.find(clientId); client != clients.end()) {
+            auto counters = client->second.getIoCounters();
+            removedIoCounters.writeCalls += counters.writeCalls;
+            removedIoCounters.bytesWritten += counters.bytesWritten;
+        }
         // Erase the client object from the map. This sould destroy the client object and in turn safely close the client connection
         clients.erase(clientId);
+        if (handshake) {
+            handshake->forget(clientId);
+        }
     }
 
     void Server::removeAllInactiveClients() {
@@ -63,9 +148,19 @@ namespace connection {
         const std::lock_guard<std::mutex> lock(clientsMutex);
 
         // erase all clients from the map for which the isActive returns false
-        const auto count = std::erase_if(clients, [](const auto& item) {
+        const auto count = std::erase_if(clients, [this](const auto& item) {
             auto const& [key, value] = item;
-            return value.isActive() == false;
+            if (value.isActive() == false) {
+                // keep the traffic counters of the client
+                auto counters = value.getIoCounters();
+                removedIoCounters.writeCalls += counters.writeCalls;
+                removedIoCounters.bytesWritten += counters.bytesWritten;
+                if (handshake) {
+                    handshake->forget(key);
+                }
+                return true;
+            }
+            return false;
         });
     }
 
@@ -76,7 +171,7 @@ namespace connection {
 
         std::vector<ClientInfo> clientInfo;
         for (auto& client : clients) {
-            clientInfo.emplace_back(client.first, client.second.isActive(), client.second.getIP(), client.second.getRtt(), client.second.getConnectionTime(), client.second.getDisconnectionTime());
+            clientInfo.emplace_back(client.first, client.second.isActive(), client.second.getIP(), client.second.getRtt(), client.second.getConnectionTime(), client.second.getDisconnectionTime(), client.second.getQueueDelay(), client.second.isIdentified(), client.second.getName());
         }
 
         return std::move(clientInfo);
@@ -87,10 +182,98 @@ namespace connection {
         const std::lock_guard<std::mutex> lock(clientsMutex);
         try {
             auto& client = clients.at(clientId);
-            return ClientInfo(client.getClientId(), client.isActive(), client.getIP(), client.getRtt(), client.getConnectionTime(), client.getDisconnectionTime());
+            return ClientInfo(client.getClientId(), client.isActive(), client.getIP(), client.getRtt(), client.getConnectionTime(), client.getDisconnectionTime(), client.getQueueDelay(), client.isIdentified(), client.getName());
         } catch (...) {
         }
-        return ClientInfo(clientId, false, "unknown", std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+        return ClientInfo(clientId, false, "unknown", std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::milliseconds(0), std::chrono::microseconds(0), false, "???");
+    }
+
+    bool Server::isClientActive(unsigned int clientId) {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        auto client = clients.find(clientId);
+        return (client != clients.end()) && client->second.isActive();
+    }
+
+    void Server::setPipelining(bool enabled) {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        pipelining = enabled;
+        for (auto& client : clients) {
+            client.second.setPipelining(enabled);
+        }
+    }
+
+    void Server::cork() {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        corked = true;
+        for (auto& client : clients) {
+            client.second.cork();
+        }
+    }
+
+    void Server::uncork() {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        corked = false;
+        for (auto& client : clients) {
+            client.second.uncork();
+        }
+    }
+
+    void Server::cork(std::span<const unsigned int> clientIds) {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        for (auto clientId : clientIds) {
+            if (auto client = clients.find(clientId); client != clients.end()) {
+                client->second.cork();
+            }
+        }
+    }
+
+    void Server::uncork(std::span<const unsigned int> clientIds) {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        for (auto clientId : clientIds) {
+            if (auto client = clients.find(clientId); client != clients.end()) {
+                client->second.uncork();
+            }
+        }
+    }
+
+    IoCounters Server::getIoCounters() {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        IoCounters ioCounters = removedIoCounters;
+        for (auto& client : clients) {
+            auto counters = client.second.getIoCounters();
+            ioCounters.writeCalls += counters.writeCalls;
+            ioCounters.bytesWritten += counters.bytesWritten;
+        }
+        return ioCounters;
+    }
+
+    IoCounters Server::getIoCounters(std::span<const unsigned int> clientIds) {
+        // lock access to the clients list (RAII)
+        const std::lock_guard<std::mutex> lock(clientsMutex);
+
+        IoCounters ioCounters{0, 0};
+        for (auto clientId : clientIds) {
+            if (auto client = clients.find(clientId); client != clients.end()) {
+                auto counters = client->second.getIoCounters();
+                ioCounters.writeCalls += counters.writeCalls;
+                ioCounters.bytesWritten += counters.bytesWritten;
+            }
+        }
+        return ioCounters;
     }
 
     void Server::rejectIncomingConnections() {
@@ -123,7 +306,22 @@ namespace connection {
                     const std::lock_guard<std::mutex> lock(server->clientsMutex);
 
                     // Create new client instance and move the socket there
-                    server->clients.emplace(std::piecewise_construct, std::forward_as_tuple(clientId), std::forward_as_tuple(clientId, std::move(sock)));
+                    decltype(server->clients)::iterator client;
+                    if (server->reactors.empty()) {
+                        client = server->clients.emplace(std::piecewise_construct, std::forward_as_tuple(clientId), std::forward_as_tuple(clientId, std::move(sock))).first;
+                    } else {
+                        auto& reactor       = *server->reactors[server->nextReactor];
+                        server->nextReactor = (server->nextReactor + 1) % server->reactors.size();
+                        client = server->clients.emplace(std::piecewise_construct, std::forward_as_tuple(clientId), std::forward_as_tuple(clientId, std::move(sock), reactor)).first;
+                    }
+                    client->second.setPipelining(server->pipelining);
+                    // the handshake goes out first and does not hold up the server thread
+                    if (server->handshake) {
+                        client->second.runHandshake(*server->handshake);
+                    }
+                    if (server->corked) {
+                        client->second.cork();
+                    }
                     clientId++;
                 } else {
                     std::osyncstream(std::cout) << "Server thread: incoming connection rejected" << std::endl;
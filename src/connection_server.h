@@ -2,6 +2,7 @@
 #define CONNECTION_SERVER_H_
 
 #include "connection_client.h"
+#include "connection_reactor.h"
 #include "connection_transaction.h"
 #include "sockpp/tcp_acceptor.h"
 
@@ -9,8 +10,11 @@
 #include <cstdint>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <span>
 #include <thread>
+#include <vector>
 
 namespace connection {
 
@@ -30,6 +34,12 @@ namespace connection {
         std::chrono::milliseconds howLongConnected;
         // Number of milliseconds the client was disconnected
         std::chrono::milliseconds howLongDisconnected;
+        /// Mean time between scheduling a request and sending it
+        std::chrono::microseconds queueDelay;
+        /// True if the client has completed the handshake
+        bool identified;
+        /// Client name obtained by the handshake
+        std::string name;
     };
 
     /**
@@ -42,9 +52,16 @@ namespace connection {
       public:
         /**
          * Constructs and runs a server listening on the given port number.
+         *
+         * By default each client is served by its own connection thread. With a non-zero reactorCount the clients are instead
+         * multiplexed over that many event-driven reactor threads (e.g. one per core), assigned in a round-robin fashion.
+         *
          * @param[in] listenPortNo port number where the server will listen for incoming connections from clients
+         * @param[in] clientLimit maximum number of connected clients
+         * @param[in] reactorCount number of reactor threads, 0 selects a connection thread per client
+         * @param[in] handshake handshake run in the background with each accepted client (optional, must outlive the server)
          */
-        Server(uint16_t listenPortNo, size_t clientLimit = 100);
+        Server(uint16_t listenPortNo, size_t clientLimit = 100, size_t reactorCount = 0, Handshake* handshake = nullptr);
 
         /**
          * Runs a transaction with all the clients.
@@ -53,6 +70,14 @@ namespace connection {
          */
         void runTransaction(Transaction& transaction);
 
+        /**
+         * Runs a transaction with the given clients, e.g. the players of a single match.
+         *
+         * @param[in, out] transaction transaction to be run
+         * @param[in] clientIds IDs of the clients to run the transaction with (the ones that are gone or inactive are skipped)
+         */
+        void runTransaction(Transaction& transaction, std::span<const unsigned int> clientIds);
+
         /**
          * Runs a transaction with a single specified client.
          *
@@ -62,14 +87,31 @@ namespace connection {
         void runTransactionWithSingleClient(unsigned int clientId, Transaction& transaction);
 
         /**
-         * Removes a client from the server. If the client is connected, it will be first disconnected.
+         * Sends a packet that needs no response to all the active clients, without waiting for anything.
+         *
+         * The packet is copied once and shared by the clients. Each client sends it in order with its other requests.
+         *
+         * @param[in] packet packet to be sent
+         */
+        void broadcast(std::span<const uint8_t> packet);
+
+        /**
+         * Sends a packet that needs no response to the given clients, without waiting for anything.
+         *
+         * @param[in] packet packet to be sent
+         * @param[in] clientIds IDs of the clients to send the packet to (the ones that are gone are skipped)
+         */
+        void broadcast(std::span<const uint8_t> packet, std::span<const unsigned int> clientIds);
+
+        /**
+         * Removes a client from the server. If the client is connected, it will be first disconnected. The handshake forgets the client.
          *
          * @param[in] clientId client ID
          */
         void removeClient(unsigned int clientId);
 
         /**
-         * Removes all inactive clients.
+         * Removes all inactive clients. The handshake forgets them.
          */
         void removeAllInactiveClients();
 
@@ -83,6 +125,49 @@ namespace connection {
          */
         ClientInfo getClient(unsigned int clientId);
 
+        /**
+         * Returns true if the client is connected (false if it is gone, or was removed).
+         */
+        bool isClientActive(unsigned int clientId);
+
+        /**
+         * Enables or disables request pipelining for all current and future clients.
+         *
+         * When pipelining, a client gets all its scheduled requests back-to-back without waiting for the responses to the previous
+         * ones. The responses are matched to the requests in order, so e.g. a whole game tick costs a single round trip.
+         */
+        void setPipelining(bool enabled);
+
+        /**
+         * Holds back the requests of all clients, so the requests scheduled until uncork are gathered into a single frame per client.
+         */
+        void cork();
+
+        /**
+         * Sends the requests held back since cork, with a single write per client.
+         */
+        void uncork();
+
+        /**
+         * Holds back the requests of the given clients, like cork, without affecting the other clients.
+         */
+        void cork(std::span<const unsigned int> clientIds);
+
+        /**
+         * Sends the requests of the given clients held back since cork.
+         */
+        void uncork(std::span<const unsigned int> clientIds);
+
+        /**
+         * Returns the outgoing traffic counters summed over all clients (including the removed ones).
+         */
+        IoCounters getIoCounters();
+
+        /**
+         * Returns the outgoing traffic counters summed over the given clients (the removed ones are skipped).
+         */
+        IoCounters getIoCounters(std::span<const unsigned int> clientIds);
+
         /**
          * Makes the server reject all further incoming connections.
          */
@@ -96,14 +181,26 @@ namespace connection {
       private:
         /// Server thread instance
         std::thread serverThread;
+        /// Reactors serving the clients (empty if each client runs its own connection thread)
+        std::vector<std::unique_ptr<Reactor>> reactors;
+        /// Reactor that will serve the next accepted client
+        size_t nextReactor{0};
         /// Map of clients. Each client is identified by a unique id (unsigned int)
         std::map<unsigned int, ConnectionClient> clients;
         /// Protects access to the clients
         std::mutex clientsMutex;
+        /// Flag that controls if the clients pipeline their requests
+        std::atomic<bool> pipelining{false};
+        /// Flag that controls if the clients hold back their requests
+        std::atomic<bool> corked{false};
+        /// Traffic counters of the clients that were already removed
+        IoCounters removedIoCounters{0, 0};
         /// Flag that controls if the server is accepting incoming connections (true) or not (false)
         std::atomic<bool> isAccepting;
         /// Limit on the number of accepted clients
         size_t clientLimit;
+        /// Handshake run with each accepted client
+        Handshake* handshake;
         /**
          * Implementation of the server thread.
          * @param[in] server server instance
@@ -5,12 +5,33 @@
 #include "connection_client.h"
 #include "sockpp/tcp_acceptor.h"
 #include <span>
-#include <map>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 namespace connection {
 
+/** Outcome of a transaction with a single client */
+enum class ClientOutcome {
+	/// the client has responded (or the request without response was sent)
+	DONE,
+	/// the client did not respond in time, or is gone
+	TIMEOUT,
+	/// the client responded with an invalid response
+	INVALID
+};
+
+/** Result of a transaction with a single client */
+struct ClientResult {
+	/// Client identifier
+	unsigned int clientId;
+	/// Outcome of the transaction
+	ClientOutcome outcome;
+	/// Time from sending the request to finishing the transaction (or time elapsed so far on timeout)
+	std::chrono::microseconds latency;
+};
+
 /**
  * This class represents a transaction (request-response) between a server and one or more remote clients.
  * The transaction is always initiated by the server sending request data.
@@ -23,56 +44,141 @@ public:
 	 * Creates a transaction.
 	 *
 	 * @param[in] requestData data that will be sent as a request
-	 * @param[in] expectedResponseSize expected size (in bytes) of the response. Value of 0 means that there will be no response
+	 * @param[in] expectedResponseSize maximum size (in bytes) of the response. Value of 0 means that there will be no response
 	 * @param[in] responseValidator response validation object used to validate the response
+	 * @param[in] expectedResponseType AMCOM packet type of the response - a response of another type is invalid
 	 */
-	Transaction (std::span<const uint8_t> requestData, std::size_t expectedResponseSize = 0, TransactionResponseValidator& responseValidator = defaultTransactionResponseValidator) : request(requestData), responseSize(expectedResponseSize), validator(responseValidator) {
+	Transaction (std::span<const uint8_t> requestData, std::size_t expectedResponseSize = 0, TransactionResponseValidator& responseValidator = defaultTransactionResponseValidator, int expectedResponseType = anyResponseType) : request(requestData), responseSize(expectedResponseSize), responseType(expectedResponseType), validator(responseValidator) {
 		;
 	}
 	virtual ~Transaction() { ; }
 
 	/**
-	 * Waits at most the given time for the transaction to finish.
+	 * Waits at most the given time for the transaction to finish. Returns as soon as all the clients have finished.
+	 * @return number of clients that finished successfully
 	 */
 	template< class Rep, class Period >
 	std::size_t waitForFinish(const std::chrono::duration<Rep, Period>& rel_time ) {
-		const std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
+		return waitUntil(std::chrono::steady_clock::now() + rel_time);
+	}
 
-		std::size_t successCount = 0;
+	/**
+	 * Waits for the transaction to finish until a specified moment in time. Returns as soon as all the clients have finished.
+	 * Useful to wait for several transactions running concurrently with a common deadline.
+	 * @return number of clients that finished successfully
+	 */
+	template<class Clock, class Duration>
+	std::size_t waitUntil(const std::chrono::time_point<Clock, Duration>& absTime) {
+		completion.waitUntil(absTime);
 
-		for (auto& clientTransaction : clientTransactions) {
-			if (true == clientTransaction.second.waitUntil(now + rel_time)) {
+		std::size_t successCount = 0;
+		for (auto& client : running()) {
+			if (DONE == client.transaction->getState()) {
 				successCount++;
 			}
 		}
 		return successCount;
 	}
 
+	/**
+	 * Waits at most the given time for the transaction to finish. Returns as soon as all the clients have finished.
+	 * Then calls the visitor with the outcome and latency of the transaction with each client (const ClientResult&).
+	 */
+	template< class Rep, class Period, class Visitor >
+	void waitForResults(const std::chrono::duration<Rep, Period>& rel_time, Visitor&& visitor) {
+		completion.waitUntil(std::chrono::steady_clock::now() + rel_time);
+
+		for (auto& client : running()) {
+			ClientOutcome outcome = ClientOutcome::TIMEOUT;
+			switch (client.transaction->getState()) {
+				case DONE: outcome = ClientOutcome::DONE; break;
+				case INVALID: outcome = ClientOutcome::INVALID; break;
+				default: break;
+			}
+			visitor(ClientResult{client.clientId, outcome, client.transaction->getLatency()});
+		}
+	}
+
+	/**
+	 * Sets the listener told each time all the clients have finished the transaction (nullptr - nobody is told), so the owner does not
+	 * have to poll isFinished(). The listener must outlive the transaction, or be reset before it is destroyed.
+	 */
+	void setCompletionListener(CompletionListener* listener) {
+		completion.setListener(listener);
+	}
+
+	/**
+	 * Returns true if all the clients have finished the transaction (successfully or not), so it may be destroyed or run again.
+	 */
+	bool isFinished() {
+		return completion.isFinished();
+	}
+
+	/**
+	 * Returns the request data, e.g. to broadcast it instead of running the transaction.
+	 */
+	std::span<const uint8_t> getRequest() const {
+		return request;
+	}
+
 	/**
 	 * Gets the response from a client with the given clientId. Usually called after waitForFinish.
 	 */
 	std::span<const uint8_t> getResponse(unsigned int clientId) {
-
+		for (auto& client : running()) {
+			if (client.clientId == clientId) {
+				return client.transaction->getResponse();
+			}
+		}
 		// return empty span
 		return std::span<const uint8_t>();
 	}
 
 	/**
-	 * Resets the transaction, so it can be run again.
+	 * Resets the transaction, so it can be run again. The client transactions are kept for the next run.
 	 */
 	virtual void reset() {
-		clientTransactions.clear();
+		runningCount = 0;
 	}
 
 protected:
 	/// Request data to be sent to all clients during the transaction
 	std::span<const uint8_t> request;
-	/// Expected response size
+	/// Maximum response size
 	std::size_t responseSize;
-	/// Vector of client transactions
-	std::map<unsigned int, ClientTransaction> clientTransactions;
+	/// Expected AMCOM packet type of the response
+	int responseType;
+	/// Client transaction with a single client
+	struct ClientSlot {
+		unsigned int clientId;
+		std::unique_ptr<ClientTransaction> transaction;
+	};
+	/// Client transactions - allocated on the first run with as many clients, then reused by the later runs
+	std::vector<ClientSlot> clientTransactions;
+	/// Number of client transactions taking part in the current run (the first ones)
+	std::size_t runningCount{0};
+	/// Counts down the unfinished client transactions
+	CompletionLatch completion;
 	/// Transaction response validator used to validate the response
 	TransactionResponseValidator& validator;
+
+	/**
+	 * Adds a client to the current run. Reuses a client transaction of an earlier run if there is one.
+	 */
+	ClientTransaction& addClient(unsigned int clientId) {
+		if (runningCount == clientTransactions.size()) {
+			clientTransactions.push_back({clientId, std::make_unique<ClientTransaction>(request, responseSize, validator, &completion, responseType)});
+		}
+		auto& client = clientTransactions[runningCount++];
+		client.clientId = clientId;
+		client.transaction->rearm(request, responseSize);
+		return *client.transaction;
+	}
+
+	/// Client transactions taking part in the current run
+	std::span<ClientSlot> running() {
+		return std::span<ClientSlot>(clientTransactions.data(), runningCount);
+	}
 };
 
 } // namespace
@@ -1,14 +1,52 @@
 #include "engine.hpp"
 
+#include <array>
+#include <bit>
 #include <iostream>
+#include <tuple>
+#include <utility>
 
 
 namespace amgame::engine {
-    template<class T> void ContactListener::handle(T& o1, WorldObject& o2) noexcept {
-        switch (o2.type()) {
-            case WorldObject::Type::BOUNDARIES: handle(o1, static_cast<MapBoundaries&>(o2)); break;
-            case WorldObject::Type::FOOD: handle(o1, static_cast<Food&>(o2)); break;
-            case WorldObject::Type::PLAYER: handle(o1, static_cast<Player&>(o2)); break;
+    namespace {
+        using Handler = void (*)(WorldObject& o1, WorldObject& o2) noexcept;
+
+        /// Object types, in the order of their WorldObject::Type bits
+        using ObjectTypes                     = std::tuple<MapBoundaries, Food, Player>;
+        constexpr std::size_t objectTypeCount = std::tuple_size_v<ObjectTypes>;
+
+        constexpr std::size_t typeIndex(WorldObject::Type type) noexcept {
+            return std::countr_zero(static_cast<unsigned>(type));
+        }
+        static_assert(typeIndex(WorldObject::Type::BOUNDARIES) == 0 && typeIndex(WorldObject::Type::FOOD) == 1 && typeIndex(WorldObject::Type::PLAYER) == 2);
+
+        template<class T1, class T2> void dispatch(WorldObject& o1, WorldObject& o2) noexcept {
+            ContactListener::handle(static_cast<T1&>(o1), static_cast<T2&>(o2));
+        }
+
+        /// Returns the handler of the pair of object types, or nullptr if there are no game rules for the pair
+        template<class T1, class T2> constexpr Handler handlerFor() noexcept {
+            if constexpr (requires(T1& o1, T2& o2) { ContactListener::handle(o1, o2); }) {
+                return &dispatch<T1, T2>;
+            } else {
+                return nullptr;
+            }
+        }
+
+        template<std::size_t... I> constexpr std::array<Handler, sizeof...(I)> makeDispatchTable(std::index_sequence<I...>) noexcept {
+            return {handlerFor<std::tuple_element_t<I / objectTypeCount, ObjectTypes>, std::tuple_element_t<I % objectTypeCount, ObjectTypes>>()...};
+        }
+
+        /// Handler of each pair of object types, indexed by typeIndex(o1) * objectTypeCount + typeIndex(o2)
+        constexpr auto dispatchTable = makeDispatchTable(std::make_index_sequence<objectTypeCount * objectTypeCount>());
+    } // namespace
+
+    void ContactListener::resolveContacts() noexcept {
+        for (auto const& event : events) {
+            auto const handler = dispatchTable[typeIndex(event.o1->type()) * objectTypeCount + typeIndex(event.o2->type())];
+            if (handler) {
+                handler(*event.o1, *event.o2);
+            }
         }
     }
 
@@ -30,19 +68,22 @@ namespace amgame::engine {
             if (verbose) {
                 std::cout << "C " << o1->type() << ' ' << o2->type() << "\n";
             }
-
-            switch (o1->type()) {
-                case WorldObject::Type::BOUNDARIES: handle(static_cast<MapBoundaries&>(*o1), *o2); break;
-                case WorldObject::Type::FOOD: handle(static_cast<Food&>(*o1), *o2); break;
-                case WorldObject::Type::PLAYER: handle(static_cast<Player&>(*o1), *o2); break;
+            record(*o1, *o2);
+            if ((WorldObject::Type::PLAYER == o1->type()) && (WorldObject::Type::PLAYER == o2->type())) {
+                touchingPlayers.emplace_back(static_cast<Player*>(o1), static_cast<Player*>(o2));
             }
         }
     }
 
-    void ContactListener::EndContact([[maybe_unused]] b2Contact* contact) {
+    void ContactListener::EndContact(b2Contact* contact) {
         if (verbose) {
             std::cout << "Contact End\n";
         }
+        auto o1 = reinterpret_cast<WorldObject*>(contact->GetFixtureA()->GetBody()->GetUserData().pointer);
+        auto o2 = reinterpret_cast<WorldObject*>(contact->GetFixtureB()->GetBody()->GetUserData().pointer);
+        if (o1 && o2 && (WorldObject::Type::PLAYER == o1->type()) && (WorldObject::Type::PLAYER == o2->type())) {
+            std::erase(touchingPlayers, std::pair{static_cast<Player*>(o1), static_cast<Player*>(o2)});
+        }
     }
 
 
@@ -66,12 +107,6 @@ namespace amgame::engine {
     }
 
 
-    void ContactListener::handle(Food& o1, Food& o2) noexcept {
-        if (verbose) {
-            std::cout << "Food - Food\n";
-        }
-    }
-
     void ContactListener::handle(Food& o1, Player& o2) noexcept {
         if (verbose) {
             std::cout << "Food - Player\n";
@@ -101,39 +136,97 @@ namespace amgame::engine {
     }
 
     void World::init() noexcept {
-        for (auto& player : players) {
-            player->update();
-        }
-        for (auto& f : food) {
-            f->update();
-        }
+        updateChanged();
+        placeFood();
     }
 
     void World::step() noexcept {
+        auto const start = std::chrono::steady_clock::now();
+        contactListener.clearContacts();
         world.Step(timeStep, velocityIterations, positionIterations);
         processOngioingContacts();
-        for (auto& player : players) {
-            player->update();
+        processFoodContacts();
+        contactListener.resolveContacts();
+        // the eaten food leaves the grid
+        for (auto const& event : contactListener.getContacts()) {
+            for (auto o : {event.o1, event.o2}) {
+                if ((WorldObject::Type::FOOD == o->type()) && !static_cast<Food*>(o)->alive()) {
+                    foodGrid.remove(static_cast<Food&>(*o));
+                }
+            }
+        }
+        if (eagerUpdate) {
+            updateAll();
+        } else {
+            updateChanged();
+        }
+        // the food added meanwhile has its radius from the update now
+        placeFood();
+        stepTime += std::chrono::steady_clock::now() - start;
+        stepCount++;
+    }
+
+    double World::getStepsPerSecond() const noexcept {
+        return (stepTime.count() > 0) ? stepCount / std::chrono::duration<double>(stepTime).count() : 0.0;
+    }
+
+
+    void World::processOngioingContacts() noexcept {
+        // only the touching players have ongoing contacts with game rules, so the rest of the contact list is not scanned
+        for (auto [p1, p2] : contactListener.getTouchingPlayers()) {
+            if (verbose) {
+                std::cout << "C " << p1->type() << ' ' << p2->type() << "\n";
+            }
+            contactListener.record(*p1, *p2);
+        }
+    }
+
+    void World::updateChanged() noexcept {
+        // the lists hold the objects of their kind only, and the objects are never removed from the world
+        for (auto mortal : changedPlayers) {
+            static_cast<Player*>(mortal)->update();
+        }
+        changedPlayers.clear();
+        for (auto mortal : changedFood) {
+            static_cast<Food*>(mortal)->update();
+        }
+        changedFood.clear();
+    }
+
+    void World::updateAll() noexcept {
+        for (auto& p : players) {
+            p->update();
         }
         for (auto& f : food) {
             f->update();
         }
+        // every changed object is up to date now
+        changedPlayers.clear();
+        changedFood.clear();
     }
 
+    void World::placeFood() noexcept {
+        if (unplacedFood.empty()) {
+            return;
+        }
+        auto const half = boundaries.sideLength() / 2;
+        for (auto f : unplacedFood) {
+            auto const p = f->getPosition();
+            auto const r = f->getRadius();
+            if (f->alive() && ((p.x - r < -half) || (p.x + r > half) || (p.y - r < -half) || (p.y + r > half))) {
+                ContactListener::handle(boundaries, *f);
+            }
+        }
+        std::erase_if(unplacedFood, [](const Food* f) { return !f->alive(); });
+        foodGrid.insert(unplacedFood);
+        unplacedFood.clear();
+    }
 
-    void World::processOngioingContacts() noexcept {
-        for (auto contact = world.GetContactList(); contact; contact = contact->GetNext()) {
-            if (contact->IsTouching()) {
-                auto o1 = reinterpret_cast<WorldObject*>(contact->GetFixtureA()->GetBody()->GetUserData().pointer);
-                auto o2 = reinterpret_cast<WorldObject*>(contact->GetFixtureB()->GetBody()->GetUserData().pointer);
-                if (o1 && o2) {
-                    if (verbose) {
-                        std::cout << "C " << o1->type() << ' ' << o2->type() << "\n";
-                    }
-                    if (WorldObject::Type::PLAYER == o1->type() && WorldObject::Type::PLAYER == o2->type()) {
-                        ContactListener::handle(static_cast<Player&>(*o1), static_cast<Player&>(*o2));
-                    }
-                }
+    void World::processFoodContacts() noexcept {
+        // only the cells around each player are checked, so the cost follows the food density rather than the amount of food
+        for (auto& player : players) {
+            if (player->alive()) {
+                foodGrid.collide(player->getPosition(), player->getRadius(), [this, &player](Food& f) { contactListener.record(f, *player); });
             }
         }
     }
@@ -3,25 +3,61 @@
 #pragma once
 
 #include "box2d.h"
+#include "food_grid.hpp"
 #include "world_object.hpp"
 
-#include <list>   // std::list
-#include <memory> // std::unique_ptr
-#include <random> // std::random_device
+#include <chrono>  // std::chrono::nanoseconds
+#include <list>    // std::list
+#include <memory>  // std::unique_ptr
+#include <random>  // std::random_device
+#include <span>    // std::span
+#include <utility> // std::pair
+#include <vector>  // std::vector
 
 
 namespace amgame::engine {
     constexpr static bool verbose{false};
 
 
+    /// Contact of two world objects, recorded during a step and resolved after it
+    struct ContactEvent {
+        WorldObject* o1;
+        WorldObject* o2;
+    };
+
+
+    /**
+     * Records the contacts into a flat event buffer instead of applying the game rules inside the Box2D callbacks.
+     *
+     * The recorded contacts are resolved after the step in a single pass, in the order they were recorded, through a table of handlers
+     * generated at compile time for each pair of object types.
+     */
     class ContactListener : public b2ContactListener {
       protected:
         void BeginContact(b2Contact* contact) override;
-        void EndContact([[maybe_unused]] b2Contact* contact) override;
+        void EndContact(b2Contact* contact) override;
         void PreSolve(b2Contact* contact, const b2Manifold* oldManifold) override;
 
       public:
-        template<class T> static void handle(T& o1, WorldObject& o2) noexcept;
+        /// Number of the events the buffer has room for up front
+        constexpr static std::size_t eventCapacity{1024};
+
+        ContactListener() { events.reserve(eventCapacity); }
+
+        /// Records a contact to be resolved by resolveContacts()
+        void record(WorldObject& o1, WorldObject& o2) { events.push_back({&o1, &o2}); }
+
+        /// Applies the game rules to the recorded contacts in the order they were recorded
+        void resolveContacts() noexcept;
+
+        /// Returns the contacts recorded since the last clearContacts()
+        std::span<const ContactEvent> getContacts() const noexcept { return events; }
+
+        /// Drops the recorded contacts, keeping the buffer
+        void clearContacts() noexcept { events.clear(); }
+
+        /// Returns the pairs of the players touching each other, kept up to date by BeginContact and EndContact
+        std::span<const std::pair<Player*, Player*>> getTouchingPlayers() const noexcept { return touchingPlayers; }
 
         static void handle(MapBoundaries& o1, MapBoundaries& o2) noexcept;
 
@@ -29,8 +65,6 @@ namespace amgame::engine {
 
         static void handle(MapBoundaries& o1, Player& o2) noexcept;
 
-        static void handle(Food& o1, Food& o2) noexcept;
-
         static void handle(Food& o1, Player& o2) noexcept;
 
         static void handle(Player& o1, Player& o2) noexcept;
@@ -44,6 +78,10 @@ namespace amgame::engine {
         static void handle(Player& o1, Food& o2) noexcept {
             handle(o2, o1);
         }
+
+      private:
+        std::vector<ContactEvent>                events;
+        std::vector<std::pair<Player*, Player*>> touchingPlayers;
     };
 
 
@@ -55,10 +93,36 @@ namespace amgame::engine {
         constexpr static float          timeStep{900.0f / (600.0f)};
         std::mt19937                    gen; // seed the generator
         std::uniform_int_distribution<> distr;
+        /// Side length of the food grid cells - a player of the initial size touches the food in a few cells around it
+        constexpr static float foodCellSize{2 * Mortal::minRadius};
+
+        /// Living food, by position
+        FoodGrid foodGrid;
+        /// Food added since the last step, not in the grid yet
+        std::vector<Food*> unplacedFood;
+        /// Players and food whose hitpoints changed since their last update
+        Mortal::ChangeList changedPlayers;
+        Mortal::ChangeList changedFood;
+        /// If set, every object is updated after a step instead of the changed ones only
+        bool eagerUpdate{false};
+
+        /// Number of steps and the time they took
+        std::size_t              stepCount{0};
+        std::chrono::nanoseconds stepTime{0};
 
         void processOngioingContacts() noexcept;
+        /// Kills the new food touching the boundaries and puts the rest into the grid
+        void placeFood() noexcept;
+        /// Records the contacts of the players with the food
+        void processFoodContacts() noexcept;
+        /// Updates the radius and the enabled state of the objects whose hitpoints changed
+        void updateChanged() noexcept;
+        /// Updates the radius and the enabled state of every object
+        void updateAll() noexcept;
 
       public:
+        constexpr static const char* backendName{"Box2D"};
+
         b2World                            world{gravity};
         std::list<std::unique_ptr<Food>>   food{};
         std::list<std::unique_ptr<Player>> players{};
@@ -67,13 +131,18 @@ namespace amgame::engine {
 
 
       public:
-        World(float size) noexcept : boundaries(world, size), gen(std::random_device()()), distr(-size / 2 + Mortal::minRadius, size / 2 - Mortal::minRadius) {
+        World(float size) noexcept :
+            gen(std::random_device()()), distr(-size / 2 + Mortal::minRadius, size / 2 - Mortal::minRadius), foodGrid(size, foodCellSize), boundaries(world, size) {
             world.SetContactListener(&contactListener);
         }
 
+        // the players destroy their bodies after the contact listener is gone, so Box2D must not report the ended contacts to it
+        ~World() { world.SetContactListener(nullptr); }
+
 
         Food& addFood(b2Vec2 p) {
-            food.push_back(std::make_unique<Food>(world, p));
+            food.push_back(std::make_unique<Food>(Vector2D{p.x, p.y}, &changedFood));
+            unplacedFood.push_back(food.back().get());
             return *food.back();
         }
         Food& addFood() {
@@ -81,7 +150,7 @@ namespace amgame::engine {
         };
 
         Player& addPlayer(b2Vec2 p) {
-            players.push_back(std::make_unique<Player>(world, p));
+            players.push_back(std::make_unique<Player>(world, p, &changedPlayers));
             return *players.back();
         }
         Player& addPlayer() {
@@ -90,6 +159,53 @@ namespace amgame::engine {
 
         void init() noexcept;
         void step() noexcept;
+
+        /**
+         * Selects the update after each step: the objects whose hitpoints changed only (default), or every player and every food as
+         * before the change lists. The eager update is kept to measure the difference (see bench/step_bench.cpp).
+         */
+        void setEagerUpdate(bool enabled) noexcept { eagerUpdate = enabled; }
+
+        /// Returns the number of steps per second of the time spent stepping the world
+        double getStepsPerSecond() const noexcept;
+
+        /**
+         * @brief Calls the visitor for each enabled food and player whose center lies within the radius from the center
+         *
+         * @param center center of the queried area
+         * @param radius radius of the queried area
+         * @param visitor callable taking the object (WorldObject&) and its distance from the center (float)
+         */
+        template<class Visitor> void query(Vector2D center, float radius, Visitor&& visitor) const {
+            class Callback : public b2QueryCallback {
+              public:
+                Callback(Vector2D center, float radius, Visitor& visitor) : center(center), radius(radius), visitor(visitor) {}
+
+                bool ReportFixture(b2Fixture* fixture) override {
+                    auto object = reinterpret_cast<WorldObject*>(fixture->GetBody()->GetUserData().pointer);
+                    if (object && (object->type() != WorldObject::Type::BOUNDARIES)) {
+                        auto const p        = fixture->GetBody()->GetPosition();
+                        auto const distance = std::hypot(p.x - center.x, p.y - center.y);
+                        if (distance <= radius) {
+                            visitor(*object, distance);
+                        }
+                    }
+                    // continue the query
+                    return true;
+                }
+
+              private:
+                Vector2D center;
+                float    radius;
+                Visitor& visitor;
+            } callback(center, radius, visitor);
+
+            b2AABB aabb;
+            aabb.lowerBound = b2Vec2{center.x - radius, center.y - radius};
+            aabb.upperBound = b2Vec2{center.x + radius, center.y + radius};
+            world.QueryAABB(&callback, aabb);
+            foodGrid.query(center, radius, visitor);
+        }
     };
 } // namespace amgame::engine
 #endif
@@ -0,0 +1,69 @@
+#include "food_grid.hpp"
+
+#include <algorithm>
+
+
+namespace amgame::engine {
+    FoodGrid::FoodGrid(float sideLength, float cellSize) :
+        half(sideLength / 2), cellSize(cellSize), cellsPerSide(std::max<std::size_t>(1, std::size_t(std::ceil(sideLength / cellSize)))),
+        cellStart(cellsPerSide * cellsPerSide + 1, 0), cellCount(cellsPerSide * cellsPerSide, 0) {}
+
+    std::size_t FoodGrid::size() const noexcept {
+        std::size_t count = 0;
+        for (auto const c : cellCount) {
+            count += c;
+        }
+        return count;
+    }
+
+    bool FoodGrid::remove(const Food& food) noexcept {
+        auto const p     = food.getPosition();
+        auto const cell  = cellOf(p.y) * cellsPerSide + cellOf(p.x);
+        auto const start = cellStart[cell];
+        for (uint32_t i = start; i < start + cellCount[cell]; i++) {
+            if (entries[i].food == &food) {
+                // the last entry of the cell takes the place of the removed one
+                entries[i] = entries[start + cellCount[cell] - 1];
+                cellCount[cell]--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::size_t FoodGrid::cellOf(float coordinate) const noexcept {
+        auto const cell = std::floor((coordinate + half) / cellSize);
+        return std::size_t(std::clamp(cell, 0.0f, float(cellsPerSide - 1)));
+    }
+
+    void FoodGrid::insert(std::span<Food* const> newFood) {
+        // the food still in the grid and the new food, sorted into the cells by counting
+        std::vector<Entry> all;
+        all.reserve(size() + newFood.size());
+        for (std::size_t cell = 0; cell < cellCount.size(); cell++) {
+            all.insert(all.end(), entries.begin() + cellStart[cell], entries.begin() + cellStart[cell] + cellCount[cell]);
+        }
+        for (auto f : newFood) {
+            auto const p = f->getPosition();
+            all.push_back({p.x, p.y, f->getRadius(), f});
+            maxFoodRadius = std::max(maxFoodRadius, f->getRadius());
+        }
+
+        std::ranges::fill(cellCount, 0);
+        for (auto const& e : all) {
+            cellCount[cellOf(e.y) * cellsPerSide + cellOf(e.x)]++;
+        }
+        cellStart[0] = 0;
+        for (std::size_t cell = 0; cell < cellCount.size(); cell++) {
+            cellStart[cell + 1] = cellStart[cell] + cellCount[cell];
+        }
+        entries.resize(all.size());
+        // cellCount counts the entries placed so far while filling
+        std::ranges::fill(cellCount, 0);
+        for (auto const& e : all) {
+            auto const cell                              = cellOf(e.y) * cellsPerSide + cellOf(e.x);
+            entries[cellStart[cell] + cellCount[cell]++] = e;
+        }
+    }
+
+} // namespace amgame::engine
@@ -0,0 +1,115 @@
+#ifndef FOOD_GRID_HPP_
+#define FOOD_GRID_HPP_
+#pragma once
+
+#include "world_object.hpp"
+
+#include <cmath>   // std::hypot
+#include <cstdint> // uint32_t
+#include <span>    // std::span
+#include <vector>  // std::vector
+
+
+namespace amgame::engine {
+    /**
+     * Uniform grid over the map holding the living food.
+     *
+     * The cells are stored back to back in a single array of entries (each cell is a range of it), and each entry keeps a copy of the
+     * position and the radius of its food, so scanning the cells around a player touches a few contiguous runs of memory only. The
+     * food does not move and its radius only changes when it is eaten, so the copies stay valid for as long as the food is in the grid.
+     * The eaten food is swapped out of its cell, the new food is added by rebuilding the grid.
+     */
+    class FoodGrid {
+      public:
+        /**
+         * @brief Constructs an empty grid covering the map
+         *
+         * @param sideLength side length of the map (centered at the origin)
+         * @param cellSize side length of a cell
+         */
+        FoodGrid(float sideLength, float cellSize);
+
+        /// Adds the food to the grid (rebuilds the grid)
+        void insert(std::span<Food* const> newFood);
+
+        /// Removes the food from the grid, returns false if it is not in the grid
+        bool remove(const Food& food) noexcept;
+
+        /// Returns the number of the food in the grid
+        std::size_t size() const noexcept;
+
+        /**
+         * @brief Calls the visitor for each food whose circle overlaps the given circle
+         *
+         * @param center center of the circle
+         * @param radius radius of the circle
+         * @param visitor callable taking the food (Food&)
+         */
+        template<class Visitor> void collide(Vector2D center, float radius, Visitor&& visitor) const {
+            forEachCell(center, radius + maxFoodRadius, [&](std::size_t cell) {
+                for (uint32_t i = cellStart[cell]; i < cellStart[cell] + cellCount[cell]; i++) {
+                    auto const& e = entries[i];
+                    auto const  r = e.radius + radius;
+                    if ((e.x - center.x) * (e.x - center.x) + (e.y - center.y) * (e.y - center.y) <= r * r) {
+                        visitor(*e.food);
+                    }
+                }
+            });
+        }
+
+        /**
+         * @brief Calls the visitor for each food whose center lies within the radius from the center
+         *
+         * @param center center of the queried area
+         * @param radius radius of the queried area
+         * @param visitor callable taking the food (WorldObject&) and its distance from the center (float)
+         */
+        template<class Visitor> void query(Vector2D center, float radius, Visitor&& visitor) const {
+            forEachCell(center, radius, [&](std::size_t cell) {
+                for (uint32_t i = cellStart[cell]; i < cellStart[cell] + cellCount[cell]; i++) {
+                    auto const& e        = entries[i];
+                    auto const  distance = std::hypot(e.x - center.x, e.y - center.y);
+                    if (distance <= radius) {
+                        visitor(static_cast<WorldObject&>(*e.food), distance);
+                    }
+                }
+            });
+        }
+
+      private:
+        struct Entry {
+            float x;
+            float y;
+            float radius;
+            Food* food;
+        };
+
+        float const       half;
+        float const       cellSize;
+        std::size_t const cellsPerSide;
+        /// Largest radius of the food in the grid
+        float maxFoodRadius{0.0f};
+
+        /// The living food of the cell c is entries[cellStart[c], cellStart[c] + cellCount[c])
+        std::vector<uint32_t> cellStart;
+        std::vector<uint32_t> cellCount;
+        std::vector<Entry>    entries;
+
+        /// Returns the column (row) of the cells holding the coordinate, positions outside the map belong to the border cells
+        std::size_t cellOf(float coordinate) const noexcept;
+
+        /// Calls the function with the index of each cell overlapping the square of the given half side length around the center
+        template<class Function> void forEachCell(Vector2D center, float reach, Function&& function) const {
+            auto const firstColumn = cellOf(center.x - reach);
+            auto const lastColumn  = cellOf(center.x + reach);
+            auto const firstRow    = cellOf(center.y - reach);
+            auto const lastRow     = cellOf(center.y + reach);
+            for (auto row = firstRow; row <= lastRow; row++) {
+                for (auto column = firstColumn; column <= lastColumn; column++) {
+                    function(row * cellsPerSide + column);
+                }
+            }
+        }
+    };
+} // namespace amgame::engine
+#endif
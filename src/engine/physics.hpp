@@ -0,0 +1,18 @@
+#ifndef PHYSICS_HPP_
+#define PHYSICS_HPP_
+#pragma once
+
+/// Selects the physics engine backend of the game: Box2D (default), or the structure-of-arrays circle engine with AMGAME_SOA_ENGINE
+#ifdef AMGAME_SOA_ENGINE
+#include "soa_engine.hpp"
+namespace amgame {
+    namespace physics = soa;
+}
+#else
+#include "engine.hpp"
+namespace amgame {
+    namespace physics = engine;
+}
+#endif
+
+#endif
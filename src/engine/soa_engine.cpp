@@ -0,0 +1,190 @@
+#include "soa_engine.hpp"
+
+#include <cmath>
+
+
+namespace amgame::soa {
+    std::size_t Bodies::add(Vector2D p, int initialHP) {
+        x.push_back(p.x);
+        y.push_back(p.y);
+        vx.push_back(0.0f);
+        vy.push_back(0.0f);
+        // as in the Box2D backend, the radius follows the hitpoints from the first update on
+        radius.push_back(float(initialHP));
+        hitpoints.push_back(initialHP);
+        enabled.push_back(1);
+        return x.size() - 1;
+    }
+
+    Food& World::addFood(Vector2D p) {
+        food.push_back(std::make_unique<Food>(foodBodies, foodBodies.add(p, 1)));
+        foodObjects.push_back(food.back().get());
+        return *food.back();
+    }
+
+    Player& World::addPlayer(Vector2D p) {
+        players.push_back(std::make_unique<Player>(playerBodies, playerBodies.add(p, 2)));
+        playerObjects.push_back(players.back().get());
+        return *players.back();
+    }
+
+    void World::init() noexcept {
+        update(playerBodies);
+        update(foodBodies);
+    }
+
+    void World::step() noexcept {
+        auto const start = std::chrono::steady_clock::now();
+        // as in Box2D the contacts are found at the positions from the start of the step
+        processContacts();
+        integrate();
+        update(playerBodies);
+        update(foodBodies);
+        stepTime += std::chrono::steady_clock::now() - start;
+        stepCount++;
+    }
+
+    double World::getStepsPerSecond() const noexcept {
+        return (stepTime.count() > 0) ? stepCount / std::chrono::duration<double>(stepTime).count() : 0.0;
+    }
+
+    void World::processContacts() noexcept {
+        auto& f = foodBodies;
+        auto& p = playerBodies;
+
+        // the food touching the boundaries dies
+        for (; checkedFood < f.size(); checkedFood++) {
+            auto const i = checkedFood;
+            if (f.enabled[i] && ((f.x[i] - f.radius[i] < -half) || (f.x[i] + f.radius[i] > half) || (f.y[i] - f.radius[i] < -half) || (f.y[i] + f.radius[i] > half))) {
+                foodObjects[i]->kill();
+            }
+        }
+
+        // the players eat the food they touch
+        touching.resize(f.size());
+        for (std::size_t i = 0; i < p.size(); i++) {
+            if (!p.enabled[i]) {
+                continue;
+            }
+            auto const px = p.x[i];
+            auto const py = p.y[i];
+            auto const pr = p.radius[i];
+            // branch-free and over local pointers (the byte stores may alias the vectors otherwise), so the compiler vectorizes it
+            auto const     n       = f.size();
+            const float*   fx      = f.x.data();
+            const float*   fy      = f.y.data();
+            const float*   fr      = f.radius.data();
+            const uint8_t* fe      = f.enabled.data();
+            uint8_t*       touches = touching.data();
+            for (std::size_t j = 0; j < n; j++) {
+                auto const dx = fx[j] - px;
+                auto const dy = fy[j] - py;
+                auto const r  = fr[j] + pr;
+                touches[j]    = (dx * dx + dy * dy <= r * r) & fe[j];
+            }
+            for (std::size_t j = 0; j < f.size(); j++) {
+                if (touching[j] && f.hitpoints[j] > 0 && p.hitpoints[i] > 0) {
+                    p.hitpoints[i] += f.hitpoints[j];
+                    f.hitpoints[j] = 0;
+                }
+            }
+        }
+
+        // the bigger player eats the smaller one it touches, the players of the same size bounce off each other
+        for (std::size_t i = 0; i < p.size(); i++) {
+            for (std::size_t j = i + 1; j < p.size(); j++) {
+                if (!p.enabled[i] || !p.enabled[j]) {
+                    continue;
+                }
+                auto const dx = p.x[j] - p.x[i];
+                auto const dy = p.y[j] - p.y[i];
+                auto const r  = p.radius[j] + p.radius[i];
+                if ((dx * dx + dy * dy <= r * r) && (p.hitpoints[i] > 0) && (p.hitpoints[j] > 0)) {
+                    if (p.hitpoints[i] > p.hitpoints[j]) {
+                        p.hitpoints[i] += p.hitpoints[j];
+                        p.hitpoints[j] = 0;
+                    } else if (p.hitpoints[j] > p.hitpoints[i]) {
+                        p.hitpoints[j] += p.hitpoints[i];
+                        p.hitpoints[i] = 0;
+                    } else {
+                        bounce(i, j);
+                    }
+                }
+            }
+        }
+    }
+
+    void World::bounce(std::size_t i, std::size_t j) noexcept {
+        auto&      p        = playerBodies;
+        auto const dx       = p.x[j] - p.x[i];
+        auto const dy       = p.y[j] - p.y[i];
+        auto const distance = std::hypot(dx, dy);
+        if (distance <= 0.0f) {
+            return;
+        }
+        auto const nx = dx / distance;
+        auto const ny = dy / distance;
+        // as the Box2D bodies of equal mass with restitution 1 and no friction, the players swap their velocities along the line of centers
+        auto const vi = p.vx[i] * nx + p.vy[i] * ny;
+        auto const vj = p.vx[j] * nx + p.vy[j] * ny;
+        if (vi > vj) {
+            p.vx[i] += (vj - vi) * nx;
+            p.vy[i] += (vj - vi) * ny;
+            p.vx[j] += (vi - vj) * nx;
+            p.vy[j] += (vi - vj) * ny;
+        }
+        // and are pushed apart, so they do not stay overlapped
+        auto const push = (p.radius[i] + p.radius[j] - distance) / 2;
+        p.x[i] -= nx * push;
+        p.y[i] -= ny * push;
+        p.x[j] += nx * push;
+        p.y[j] += ny * push;
+    }
+
+    void World::integrate() noexcept {
+        auto&          p  = playerBodies;
+        auto const     n  = p.size();
+        float*         x  = p.x.data();
+        float*         y  = p.y.data();
+        const float*   vx = p.vx.data();
+        const float*   vy = p.vy.data();
+        const uint8_t* e  = p.enabled.data();
+        for (std::size_t i = 0; i < n; i++) {
+            // the disabled bodies stay where they are
+            auto const dt = e[i] ? timeStep : 0.0f;
+            x[i] += vx[i] * dt;
+            y[i] += vy[i] * dt;
+        }
+        // the boundaries reflect the players (restitution 1, no friction)
+        for (std::size_t i = 0; i < p.size(); i++) {
+            auto const lo = -half + p.radius[i];
+            auto const hi = half - p.radius[i];
+            if (p.x[i] < lo) {
+                p.x[i]  = lo;
+                p.vx[i] = std::fabs(p.vx[i]);
+            } else if (p.x[i] > hi) {
+                p.x[i]  = hi;
+                p.vx[i] = -std::fabs(p.vx[i]);
+            }
+            if (p.y[i] < lo) {
+                p.y[i]  = lo;
+                p.vy[i] = std::fabs(p.vy[i]);
+            } else if (p.y[i] > hi) {
+                p.y[i]  = hi;
+                p.vy[i] = -std::fabs(p.vy[i]);
+            }
+        }
+    }
+
+    void World::update(Bodies& bodies) noexcept {
+        auto const n      = bodies.size();
+        const int* hp     = bodies.hitpoints.data();
+        float*     radius = bodies.radius.data();
+        uint8_t*   e      = bodies.enabled.data();
+        for (std::size_t i = 0; i < n; i++) {
+            radius[i] = Mortal::minRadius + hp[i];
+            e[i]      = hp[i] > 0;
+        }
+    }
+
+} // namespace amgame::soa
@@ -0,0 +1,205 @@
+#ifndef SOA_ENGINE_HPP_
+#define SOA_ENGINE_HPP_
+#pragma once
+
+#include <chrono>  // std::chrono::nanoseconds
+#include <cmath>   // std::hypot
+#include <cstdint> // uint8_t
+#include <list>    // std::list
+#include <memory>  // std::unique_ptr
+#include <random>  // std::random_device
+#include <vector>  // std::vector
+
+
+/**
+ * Circle physics engine keeping the bodies in structure-of-arrays storage - an alternative to the Box2D backend (engine.hpp).
+ *
+ * It has the same interface and the same game rules: the players move at a constant velocity and bounce off the map boundaries, a player
+ * eats the food and the smaller players it touches, the players of the same size bounce off each other, the food touching the boundaries
+ * dies, the dead bodies leave the simulation.
+ * Everything in the game is a circle in a box, so instead of a general rigid body solver the positions, velocities, radii and hitpoints
+ * are kept in plain arrays, stepped and tested for overlaps with simple loops the compiler vectorizes.
+ */
+namespace amgame::soa {
+    struct Vector2D {
+        float x;
+        float y;
+    };
+
+    class WorldObject {
+      public:
+        enum Type { BOUNDARIES = 0x1, FOOD = 0x2, PLAYER = 0x4 };
+        Type type() const noexcept { return t; };
+        WorldObject(Type _) noexcept : t(_) {}
+
+      private:
+        Type t;
+    };
+
+
+    /// Bodies of a single kind in structure-of-arrays storage, indexed by body number
+    struct Bodies {
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> vx;
+        std::vector<float> vy;
+        std::vector<float> radius;
+        std::vector<int>   hitpoints;
+        /// 1 if the body takes part in the simulation (it was alive at the last update), 0 otherwise
+        std::vector<uint8_t> enabled;
+
+        /// Adds a body at rest, returns its number
+        std::size_t add(Vector2D p, int initialHP);
+        std::size_t size() const noexcept { return x.size(); }
+    };
+
+
+    /// World object that has hitpoints - a handle to its body
+    class Mortal {
+      public:
+        constexpr static float minRadius = 25.0f;
+        constexpr static float maxRadius = 100.0f;
+
+        Mortal(Bodies& bodies, std::size_t index) noexcept : bodies(bodies), index(index) {}
+
+        /// Returns boolean describing whether the object is alive
+        bool alive() const noexcept { return hp() > 0; }
+
+        void setPosition(Vector2D pos) noexcept {
+            bodies.x[index] = pos.x;
+            bodies.y[index] = pos.y;
+        }
+
+        /**
+         * @brief Inflict damage of given magnitude on the object
+         *
+         * @param damage amount of hitpoints to be deduced
+         */
+        void harm(int damage) noexcept { bodies.hitpoints[index] -= damage; }
+
+        /// Inflict lethal damage on the object
+        void kill() noexcept { harm(hp()); }
+
+        /**
+         * @brief Heal the object with given amount of hitpoints
+         *
+         * @param healPower amount of hitpoints to be added
+         */
+        void heal(int healPower) noexcept { bodies.hitpoints[index] += healPower; }
+
+        /// returns current hitpoint value of the object
+        int hp() const noexcept { return bodies.hitpoints[index]; }
+
+        float getRadius() const noexcept { return bodies.radius[index]; }
+
+        /// Update the world object after each world step
+        void update() noexcept {
+            bodies.radius[index]  = minRadius + hp();
+            bodies.enabled[index] = alive();
+        }
+
+        Vector2D getPosition() const noexcept { return {bodies.x[index], bodies.y[index]}; }
+
+      protected:
+        Bodies&     bodies;
+        std::size_t index;
+    };
+
+    /// World object that acts as Food
+    class Food : public WorldObject, public Mortal {
+      public:
+        Food(Bodies& bodies, std::size_t index) : WorldObject{WorldObject::Type::FOOD}, Mortal(bodies, index) {}
+    };
+
+
+    /// World object that acts as Player
+    class Player : public WorldObject, public Mortal {
+      public:
+        /// Speed of the players
+        constexpr static float speed = 10.0f;
+
+        Player(Bodies& bodies, std::size_t index) : WorldObject{WorldObject::Type::PLAYER}, Mortal(bodies, index) {}
+
+        void setAngle(float phi) noexcept {
+            bodies.vx[index] = speed * std::cos(phi);
+            bodies.vy[index] = speed * std::sin(phi);
+        }
+        float getAngle() const noexcept { return std::atan2(bodies.vy[index], bodies.vx[index]); }
+    };
+
+
+    class World {
+      private:
+        constexpr static float          timeStep{900.0f / (600.0f)};
+        std::mt19937                    gen; // seed the generator
+        std::uniform_int_distribution<> distr;
+        /// Half of the side length of the map - the boundaries are at +/- half
+        float const half;
+
+        Bodies playerBodies;
+        Bodies foodBodies;
+        /// Objects of the bodies, indexed by body number
+        std::vector<Player*> playerObjects;
+        std::vector<Food*>   foodObjects;
+        /// Number of the food bodies already checked against the boundaries - the food does not move, so it is checked once
+        std::size_t checkedFood{0};
+        /// Overlap flags of the food with a single player (scratch buffer)
+        std::vector<uint8_t> touching;
+
+        /// Number of steps and the time they took
+        std::size_t              stepCount{0};
+        std::chrono::nanoseconds stepTime{0};
+
+        /// Applies the game rules to the touching bodies
+        void processContacts() noexcept;
+        /// Resolves the elastic collision of two touching players of the same size
+        void bounce(std::size_t i, std::size_t j) noexcept;
+        /// Moves the players and bounces them off the boundaries
+        void integrate() noexcept;
+        /// Updates the radii and the enabled flags from the hitpoints
+        static void update(Bodies& bodies) noexcept;
+
+      public:
+        constexpr static const char* backendName{"SoA"};
+
+        std::list<std::unique_ptr<Food>>   food{};
+        std::list<std::unique_ptr<Player>> players{};
+
+        World(float size) noexcept : gen(std::random_device()()), distr(-size / 2 + Mortal::minRadius, size / 2 - Mortal::minRadius), half(size / 2) {}
+
+        Food& addFood(Vector2D p);
+        Food& addFood() { return addFood(Vector2D{float(distr(gen)), float(distr(gen))}); };
+
+        Player& addPlayer(Vector2D p);
+        Player& addPlayer() { return addPlayer(Vector2D{float(distr(gen)), float(distr(gen))}); }
+
+        void init() noexcept;
+        void step() noexcept;
+
+        /// Returns the number of steps per second of the time spent stepping the world
+        double getStepsPerSecond() const noexcept;
+
+        /**
+         * @brief Calls the visitor for each enabled food and player whose center lies within the radius from the center
+         *
+         * @param center center of the queried area
+         * @param radius radius of the queried area
+         * @param visitor callable taking the object (WorldObject&) and its distance from the center (float)
+         */
+        template<class Visitor> void query(Vector2D center, float radius, Visitor&& visitor) const {
+            auto visit = [&](const Bodies& bodies, const auto& objects) {
+                for (std::size_t i = 0; i < bodies.size(); i++) {
+                    if (bodies.enabled[i]) {
+                        auto const distance = std::hypot(bodies.x[i] - center.x, bodies.y[i] - center.y);
+                        if (distance <= radius) {
+                            visitor(static_cast<WorldObject&>(*objects[i]), distance);
+                        }
+                    }
+                }
+            };
+            visit(foodBodies, foodObjects);
+            visit(playerBodies, playerObjects);
+        }
+    };
+} // namespace amgame::soa
+#endif
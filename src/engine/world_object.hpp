@@ -3,8 +3,9 @@
 
 #include "box2d.h"
 
-#include <array> // std::array
+#include <array>  // std::array
 #include <cmath>
+#include <vector> // std::vector
 
 
 
@@ -53,18 +54,83 @@ namespace amgame::engine {
         auto sideLength() const noexcept { return length; }
     };
 
-    /// World object that has hitpoints
+    /**
+     * World object that has hitpoints.
+     *
+     * The radius and the enabled state follow the hitpoints, so they only need an update once the hitpoints change. A changed object adds
+     * itself to the change list it was given (once until its next update), which lets the world update the changed objects only.
+     */
     class Mortal {
+      public:
+        /// Objects whose hitpoints changed since their last update
+        using ChangeList = std::vector<Mortal*>;
+
       protected:
+        int hitpoints;
+
+        /// Called by the update of the derived object
+        void clearChanged() noexcept { changed = false; }
+
+      private:
+        ChangeList* changes;
+        bool        changed{false};
+
+        void markChanged() noexcept {
+            if (!changed) {
+                changed = true;
+                if (changes) {
+                    changes->push_back(this);
+                }
+            }
+        }
+
       public:
         constexpr static float minRadius = 25.0f;
         constexpr static float maxRadius = 100.0f;
 
+        /// A new object starts changed, so its first update sets its radius
+        Mortal(int initialHP = 1, ChangeList* changes = nullptr) noexcept : hitpoints{initialHP}, changes(changes) { markChanged(); }
+
+        /// Returns boolean describing whether the object is alive
+        bool alive() const noexcept { return hitpoints > 0; }
+
+        /**
+         * @brief Inflict damage of given magnitude on the object
+         *
+         * @param damage amount of hitpoints to be deduced
+         */
+
+        void harm(int damage) noexcept {
+            hitpoints -= damage;
+            markChanged();
+        }
+
+        /// Inflict lethal damage on the object
+        void kill() noexcept { harm(hitpoints); }
+
+        /**
+         * @brief Heal the object with given amount of hitpoints
+         *
+         * @param healPower amount of hitpoints to be added
+         */
+        void heal(int healPower) noexcept {
+            hitpoints += healPower;
+            markChanged();
+        }
+
+        /// returns current hitpoint value of the object
+        int hp() const noexcept { return hitpoints; }
+
+        /// Returns boolean describing whether the hitpoints changed since the last update
+        bool isChanged() const noexcept { return changed; }
+    };
 
-        int     hitpoints;
+    /// Mortal simulated as a Box2D body
+    class RigidMortal : public Mortal {
+      public:
         b2Body* body{nullptr};
 
-        Mortal(b2World& world, b2Vec2 p, int initialHP = 1, bool collisionEnabled = true) noexcept : hitpoints{initialHP} {
+        RigidMortal(b2World& world, b2Vec2 p, int initialHP = 1, bool collisionEnabled = true, ChangeList* changes = nullptr) noexcept : Mortal{initialHP, changes} {
             b2CircleShape circle{};
             circle.m_radius = hp();
 
@@ -85,42 +151,18 @@ namespace amgame::engine {
             body->CreateFixture(&circleShapeDef);
         }
 
-        ~Mortal() { body->GetWorld()->DestroyBody(body); }
-
-        /// Returns boolean describing whether the object is alive
-        bool alive() const noexcept { return hitpoints > 0; }
+        ~RigidMortal() { body->GetWorld()->DestroyBody(body); }
 
         void setPosition(Vector2D pos) { body->SetTransform(b2Vec2(pos.x, pos.y), body->GetAngle()); }
 
-        /**
-         * @brief Inflict damage of given magnitude on the object
-         *
-         * @param damage amount of hitpoints to be deduced
-         */
-
-        void harm(int damage) noexcept { hitpoints -= damage; }
-
-        /// Inflict lethal damage on the object
-        void kill() noexcept { harm(hitpoints); }
-
-        /**
-         * @brief Heal the object with given amount of hitpoints
-         *
-         * @param healPower amount of hitpoints to be added
-         */
-        void heal(int healPower) noexcept { hitpoints += healPower; }
-
-        /// returns current hitpoint value of the object
-        int hp() const noexcept { return hitpoints; }
-
-
         float getRadius() const noexcept { return body->GetFixtureList()->GetShape()->m_radius; }
 
-        /// Update the world object after each world step
+        /// Update the world object after its hitpoints changed
         void update() noexcept {
             // Update the radius of the object based on its hitpoints
             body->GetFixtureList()->GetShape()->m_radius = minRadius + hp();
             body->SetEnabled(alive());
+            clearChanged();
         }
 
         Vector2D getPosition() const {
@@ -134,17 +176,41 @@ namespace amgame::engine {
         }
     };
 
-    /// World object that acts as Food
+    /**
+     * World object that acts as Food.
+     *
+     * The food does not move and only touches the players, so it is not a Box2D body - the world keeps it in a FoodGrid instead.
+     */
     class Food : public WorldObject, public Mortal {
+      private:
+        Vector2D position;
+        float    radius;
+        bool     enabled{true};
+
       public:
-        Food(b2World& world, b2Vec2 p) : WorldObject{WorldObject::Type::FOOD}, Mortal(world, p, 1, false) { body->GetUserData().pointer = reinterpret_cast<decltype(body->GetUserData().pointer)>(this); }
+        // as with a Box2D body, the radius follows the hitpoints from the first update on
+        Food(Vector2D p, ChangeList* changes = nullptr) : WorldObject{WorldObject::Type::FOOD}, Mortal(1, changes), position(p), radius(float(hp())) {}
+
+        float getRadius() const noexcept { return radius; }
+
+        /// Returns boolean describing whether the object takes part in the simulation (it was alive at the last update)
+        bool isEnabled() const noexcept { return enabled; }
+
+        /// Update the world object after its hitpoints changed
+        void update() noexcept {
+            radius  = minRadius + hp();
+            enabled = alive();
+            clearChanged();
+        }
+
+        Vector2D getPosition() const noexcept { return position; }
     };
 
 
     /// World object that acts as Player
-    class Player : public WorldObject, public Mortal {
+    class Player : public WorldObject, public RigidMortal {
       public:
-        Player(b2World& world, b2Vec2 p) : WorldObject{WorldObject::Type::PLAYER}, Mortal(world, p, 2, true) { body->GetUserData().pointer = reinterpret_cast<decltype(body->GetUserData().pointer)>(this); }
+        Player(b2World& world, b2Vec2 p, ChangeList* changes = nullptr) : WorldObject{WorldObject::Type::PLAYER}, RigidMortal(world, p, 2, true, changes) { body->GetUserData().pointer = reinterpret_cast<decltype(body->GetUserData().pointer)>(this); }
 
         void setAngle(float phi) {
             // body->ApplyLinearImpulseToCenter(b2Vec2{cos(phi), sin(phi)}, true);
@@ -2,7 +2,7 @@
 
 namespace amgame {
 
-    Food::Food(engine::World& world) : engineFood(world.addFood()) {
+    Food::Food(physics::World& world) : engineFood(world.addFood()) {
         isAlive = true;
     }
 
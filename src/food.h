@@ -1,15 +1,15 @@
 #ifndef AMGAME_FOOD_H_
 #define AMGAME_FOOD_H_
 
-#include "engine.hpp"
+#include "physics.hpp"
 
 namespace amgame {
 
     class Food {
       public:
-        engine::Food& engineFood; ///< food representation in physics engine
+        physics::Food& engineFood; ///< food representation in physics engine
         bool          isAlive;
-        Food(engine::World& world);
+        Food(physics::World& world);
         ~Food();
         bool updateSprite();
 
@@ -1,5 +1,6 @@
-#include "amgame.h"
+#include "match_host.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -7,31 +8,23 @@
 #include <thread>
 
 // Application entry point
-int main(void) {
+int main(int argc, char* argv[]) {
     srand(time(NULL));
 
-    // initialize game
-    amgame::Game game;
-
-    // wait for at least two clients
-    while (1) {
-        auto clients = game.server.getClients();
-        if (clients.size() >= 2) {
-            break;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    };
-    // start new match
-    game.newMatch();
-
-    // This is the main game loop
-    while (1) {
-        // get current time in milliseconds using chrono
-        auto gameTime = std::chrono::system_clock::now();
-        game.update();
-        // check player hp
-        for (auto& p : game.players) {
-            std::cout << "Player " << p->name << ": " << p->lastHp << std::endl;
+    // clients served by the listener at once, all the matches together - may be given as the first argument
+    std::size_t clientLimit = 1024;
+    if (argc > 1) {
+        std::istringstream arg(argv[1]);
+        if (!(arg >> clientLimit) || (clientLimit == 0)) {
+            std::cerr << "Usage: " << argv[0] << " [clientLimit]" << std::endl;
+            return 1;
         }
     }
+
+    // host the matches, up to 8 players each, on a shard per core
+    amgame::MatchHost host(2001, clientLimit, 8);
+    // a match starts as soon as at least two clients are identified
+    host.setLobbyPolicy(2, std::chrono::milliseconds(0));
+    // This is the lobby loop, the matches run on the shards
+    host.run();
 }
@@ -0,0 +1,252 @@
+#include "match_host.h"
+
+#include <algorithm>
+#include <iostream>
+#include <syncstream>
+
+namespace amgame {
+
+    MatchHost::MatchHost(uint16_t listenPortNo, std::size_t clientLimit, std::size_t playersPerMatch, std::size_t shardCount, std::size_t reactorCount) :
+        server(listenPortNo, clientLimit, reactorCount, &identifyTransaction), playersPerMatch(playersPerMatch), minPlayers(playersPerMatch) {
+        if (0 == shardCount) {
+            shardCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t s = 0; s < shardCount; s++) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+        // the shards are started once they are all in place, as they steal from each other
+        for (std::size_t s = 0; s < shardCount; s++) {
+            shards[s]->thread = std::thread(shardThreadFunc, this, s);
+        }
+    }
+
+    MatchHost::~MatchHost() {
+        running = false;
+        for (auto& shard : shards) {
+            shard->thread.join();
+        }
+    }
+
+    void MatchHost::setLobbyPolicy(std::size_t minPlayers, std::chrono::milliseconds lobbyTimeout) {
+        // lock access to the lobby (RAII)
+        const std::lock_guard<std::mutex> lock(matchesMutex);
+
+        this->minPlayers   = minPlayers;
+        this->lobbyTimeout = lobbyTimeout;
+    }
+
+    void MatchHost::run(std::chrono::milliseconds reportInterval) {
+        auto nextReport = TickScheduler::Clock::now() + reportInterval;
+        while (true) {
+            retireMatches();
+            startMatches();
+            if (TickScheduler::Clock::now() >= nextReport) {
+                for (const auto& stats : getMatchStats()) {
+                    std::osyncstream(std::cout) << "Match " << stats.matchId << ": " << stats.players << " players, " << stats.ticks << " ticks, last " << stats.lastTick.count()
+                                                << " us, max " << stats.maxTick.count() << " us, max lag " << stats.maxLag.count() << " us" << std::endl;
+                }
+                nextReport += reportInterval;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    std::vector<MatchStats> MatchHost::getMatchStats() {
+        // lock access to the matches (RAII)
+        const std::lock_guard<std::mutex> lock(matchesMutex);
+
+        std::vector<MatchStats> stats;
+        stats.reserve(matches.size());
+        for (const auto& match : matches) {
+            stats.emplace_back(match->matchId, match->clientIds.size(), match->ticks.load(), std::chrono::microseconds(match->lastTick.load()),
+                               std::chrono::microseconds(match->maxTick.load()), std::chrono::microseconds(match->maxLag.load()));
+        }
+        return stats;
+    }
+
+    void MatchHost::startMatches() {
+        const auto now     = TickScheduler::Clock::now();
+        const auto clients = server.getClients();
+
+        // lock access to the lobby (RAII)
+        const std::lock_guard<std::mutex> lock(matchesMutex);
+
+        for (const auto& client : clients) {
+            if (busyClients.contains(client.clientId)) {
+                continue;
+            }
+            // the clients that are gone and do not take part in a match are of no use anymore
+            if (!client.active) {
+                lobby.erase(client.clientId);
+                server.removeClient(client.clientId);
+            } else if (client.identified) {
+                lobby.try_emplace(client.clientId, now);
+            }
+        }
+        while (lobby.size() >= minPlayers) {
+            // the clients that have waited the longest go first
+            std::vector<std::pair<TickScheduler::Clock::time_point, unsigned int>> waiting;
+            for (const auto& [clientId, since] : lobby) {
+                waiting.emplace_back(since, clientId);
+            }
+            std::ranges::sort(waiting);
+            if ((waiting.size() < playersPerMatch) && (now - waiting.front().first < lobbyTimeout)) {
+                break;
+            }
+            auto match = std::make_shared<Match>(nextMatchId++, *this, server, identifyTransaction);
+            for (std::size_t p = 0; (p < playersPerMatch) && (p < waiting.size()); p++) {
+                match->clientIds.push_back(waiting[p].second);
+                lobby.erase(waiting[p].second);
+                busyClients.insert(waiting[p].second);
+            }
+            // the physics is queued as shard work, so an idle shard runs it while the match sends its snapshot
+            match->game.setWorldStepExecutor(match.get());
+            // the shard is woken as soon as the clients have answered, instead of polling the match
+            match->game.setCompletionListener(match.get());
+            match->game.newMatch(match->clientIds);
+            match->due = now;
+            matches.push_back(match);
+            std::osyncstream(std::cout) << "Match " << match->matchId << " started on shard " << nextShard << std::endl;
+
+            // the matches are spread over the shards, the idle shards even out the load by stealing
+            auto& shard = *shards[nextShard];
+            nextShard   = (nextShard + 1) % shards.size();
+            // lock access to the shard (RAII)
+            const std::lock_guard<std::mutex> shardLock(shard.mutex);
+            shard.matches.push_back(std::move(match));
+        }
+    }
+
+    void MatchHost::retireMatches() {
+        // lock access to the matches (RAII)
+        const std::lock_guard<std::mutex> lock(matchesMutex);
+
+        std::erase_if(matches, [this](const auto& match) {
+            if (!match->over) {
+                return false;
+            }
+            std::osyncstream(std::cout) << "Match " << match->matchId << " is over after " << match->ticks << " ticks" << std::endl;
+            // the players go back to the lobby, the ones that disconnected during the match are removed by the next startMatches()
+            for (auto clientId : match->clientIds) {
+                busyClients.erase(clientId);
+            }
+            return true;
+        });
+    }
+
+    std::shared_ptr<MatchHost::Match> MatchHost::takeDueMatch(Shard& shard, TickScheduler::Clock::time_point now) {
+        // lock access to the shard (RAII)
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // a woken match is due at once
+        auto dueTime  = [](const auto& match) { return match->woken ? TickScheduler::Clock::time_point::min() : match->due; };
+        auto earliest = std::ranges::min_element(shard.matches, {}, dueTime);
+        if ((earliest == shard.matches.end()) || (dueTime(*earliest) > now)) {
+            return nullptr;
+        }
+        auto match = std::move(*earliest);
+        shard.matches.erase(earliest);
+        return match;
+    }
+
+    std::shared_ptr<MatchHost::Match> MatchHost::takeWorldStep(Shard& shard) {
+        // lock access to the shard (RAII)
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+
+        if (shard.worldSteps.empty()) {
+            return nullptr;
+        }
+        auto match = std::move(shard.worldSteps.front());
+        shard.worldSteps.pop_front();
+        return match;
+    }
+
+    void MatchHost::wake(Shard& shard) {
+        {
+            // lock access to the shard (RAII), so the wake-up cannot slip in between the shard checking its matches and going to sleep
+            const std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.signalled = true;
+        }
+        shard.wakeUp.notify_one();
+    }
+
+    void MatchHost::Match::submit(Game&) {
+        // called by the shard running the match, which goes on sending the snapshot - the next shard is woken to steal the step meanwhile
+        Shard* const current = shard;
+        {
+            const std::lock_guard<std::mutex> lock(current->mutex);
+            current->worldSteps.push_back(shared_from_this());
+        }
+        if (host.shards.size() > 1) {
+            auto self = std::ranges::find_if(host.shards, [current](const auto& s) { return s.get() == current; });
+            auto next = std::next(self) == host.shards.end() ? host.shards.begin() : std::next(self);
+            wake(**next);
+        }
+    }
+
+    void MatchHost::Match::transactionFinished() {
+        // the shard running the match sees the flag once the match is back, the shard holding it is woken
+        woken = true;
+        if (Shard* const current = shard) {
+            wake(*current);
+        }
+    }
+
+    void MatchHost::shardThreadFunc(MatchHost* host, std::size_t shardNo) {
+        auto& shard = *host->shards[shardNo];
+        while (host->running) {
+            auto now   = TickScheduler::Clock::now();
+            auto match = takeDueMatch(shard, now);
+            // nothing due here - help the other shards
+            for (std::size_t s = 1; !match && (s < host->shards.size()); s++) {
+                match = takeDueMatch(*host->shards[(shardNo + s) % host->shards.size()], now);
+            }
+            if (!match) {
+                // no match is due anywhere, so the queued physics is run - of this shard first
+                std::shared_ptr<Match> step;
+                for (std::size_t s = 0; !step && (s < host->shards.size()); s++) {
+                    step = takeWorldStep(*host->shards[(shardNo + s) % host->shards.size()]);
+                }
+                if (step) {
+                    // a no-op if the match has already run the step itself
+                    step->game.runWorldStep();
+                    continue;
+                }
+                // sleep until the next match of this shard is due or is woken, but look for a match to steal now and then
+                auto wakeUp = now + stealInterval;
+                // lock access to the shard (RAII)
+                std::unique_lock<std::mutex> lock(shard.mutex);
+                for (const auto& m : shard.matches) {
+                    wakeUp = std::min(wakeUp, m->woken ? now : m->due);
+                }
+                shard.wakeUp.wait_until(lock, wakeUp, [&shard] { return shard.signalled; });
+                shard.signalled = false;
+                continue;
+            }
+
+            // the match is run by this shard only, as it is not in any shard meanwhile
+            const auto lag   = std::chrono::duration_cast<std::chrono::microseconds>(now - match->due).count();
+            const auto ticks = match->game.scheduler.getTickCount();
+            match->shard     = &shard;
+            // a transaction finishing from now on makes the match due again
+            match->woken     = false;
+            match->due       = match->game.runTick();
+            match->maxLag    = std::max<int64_t>(match->maxLag, lag);
+            if (match->game.scheduler.getTickCount() != ticks) {
+                const auto tick = match->game.scheduler.getLastTickDuration().count();
+                match->ticks    = match->game.scheduler.getTickCount();
+                match->lastTick = tick;
+                match->maxTick  = std::max<int64_t>(match->maxTick, tick);
+            }
+            if (match->game.isOver()) {
+                // the lobby retires the match
+                match->over = true;
+                continue;
+            }
+            // a stolen match stays with the shard that ran it
+            const std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.matches.push_back(std::move(match));
+        }
+    }
+
+} // namespace amgame
@@ -0,0 +1,180 @@
+#ifndef AMGAME_MATCH_HOST_H_
+#define AMGAME_MATCH_HOST_H_
+
+#include "amcom_transactions.h"
+#include "amgame.h"
+#include "connection_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace amgame {
+
+    /**
+     * Per-match statistics reported by the match host.
+     */
+    struct MatchStats {
+        /// Match identifier
+        unsigned int matchId;
+        /// Number of players in the match
+        std::size_t players;
+        /// Number of finished ticks
+        std::size_t ticks;
+        /// Duration of the last tick, from its scheduled start to its end
+        std::chrono::microseconds lastTick;
+        /// Longest tick so far
+        std::chrono::microseconds maxTick;
+        /// Longest delay between the time the match was due to run and the time a shard ran it
+        std::chrono::microseconds maxLag;
+    };
+
+    /**
+     * Hosts many concurrent matches in a single process.
+     *
+     * All the matches share a single server (one listener) and a lobby: the identified clients that are not playing wait in the lobby
+     * until there are enough of them to start a match. The matches are sharded across a pool of worker threads, one per core. Each shard
+     * runs the matches that are due, and a shard with nothing due steals a due match from another shard.
+     *
+     * The physics of a tick is queued as shard work while the match sends its snapshot: a shard with no match due runs the queued
+     * physics of its own matches, or steals it from another shard, so the physics overlaps the network instead of following it.
+     * A match waiting for its clients is not polled: it is due at its response cutoff, and the transaction that finishes first makes
+     * it due at once and wakes its shard.
+     */
+    class MatchHost {
+      public:
+        /**
+         * Constructs a match host and starts its shards.
+         *
+         * @param[in] listenPortNo port number where the server listens for incoming connections from clients
+         * @param[in] clientLimit maximum number of connected clients
+         * @param[in] playersPerMatch number of players a match is started with
+         * @param[in] shardCount number of shards (worker threads), 0 selects one per core
+         * @param[in] reactorCount number of reactor threads serving the clients, 0 selects a connection thread per client
+         */
+        MatchHost(uint16_t listenPortNo, std::size_t clientLimit, std::size_t playersPerMatch, std::size_t shardCount = 0, std::size_t reactorCount = 0);
+        ~MatchHost();
+
+        /**
+         * Sets the lobby policy: a match starts as soon as playersPerMatch clients are waiting, or with at least minPlayers clients
+         * once the longest waiting one has waited for lobbyTimeout.
+         */
+        void setLobbyPolicy(std::size_t minPlayers, std::chrono::milliseconds lobbyTimeout);
+
+        /**
+         * Runs the lobby on the calling thread: starts the matches, retires the finished ones and reports the statistics. Never returns.
+         *
+         * @param[in] reportInterval time between two reports of the match statistics
+         */
+        void run(std::chrono::milliseconds reportInterval = std::chrono::seconds(10));
+
+        /**
+         * Returns the statistics of the running matches. This is a snapshot of the current state.
+         */
+        std::vector<MatchStats> getMatchStats();
+
+        /// Connection server shared by the matches
+        connection::Server& getServer() { return server; }
+
+      private:
+        struct Shard;
+
+        /// A hosted match
+        struct Match : public WorldStepExecutor, public connection::CompletionListener, public std::enable_shared_from_this<Match> {
+            Match(unsigned int matchId, MatchHost& host, connection::Server& server, IdentifyTransaction& identifyTransaction) :
+                matchId(matchId), host(host), game(server, identifyTransaction) {}
+
+            /// Queues the physics of the game on the shard running the match
+            void submit(Game& game) override;
+            /// Makes the match due at once and wakes its shard
+            void transactionFinished() override;
+
+            unsigned int matchId;
+            MatchHost&   host;
+            /// Shard the match is run by (set by the shard before each run) - declared before the game, whose transactions tell the match
+            std::atomic<Shard*> shard{nullptr};
+            /// Set once a transaction of the match has finished, the match is then due regardless of its due time
+            std::atomic<bool> woken{false};
+            Game              game;
+            /// Time the match is due to run again
+            TickScheduler::Clock::time_point due;
+            /// Clients taking part in the match
+            std::vector<unsigned int> clientIds;
+            /// Statistics (in us), written by the shard running the match
+            std::atomic<std::size_t> ticks{0};
+            std::atomic<int64_t>     lastTick{0};
+            std::atomic<int64_t>     maxTick{0};
+            std::atomic<int64_t>     maxLag{0};
+            /// Set by the shard once the game is over
+            std::atomic<bool> over{false};
+        };
+
+        /// Matches run by a single worker thread
+        struct Shard {
+            std::mutex                          mutex;
+            std::vector<std::shared_ptr<Match>> matches;
+            /// Matches whose physics is queued, oldest first
+            std::deque<std::shared_ptr<Match>> worldSteps;
+            /// Wakes the shard thread once a match of the shard is woken or physics is queued
+            std::condition_variable wakeUp;
+            bool                    signalled{false};
+            std::thread             thread;
+        };
+
+        /// Longest a shard sleeps before it looks for a match to steal
+        constexpr static std::chrono::milliseconds stealInterval{1};
+
+        /// Identify transaction, run by the server with each accepted client (declared before the server, which uses it)
+        IdentifyTransaction identifyTransaction;
+        /// Connection server shared by the matches
+        connection::Server server;
+        std::size_t        playersPerMatch;
+        std::size_t        minPlayers;
+        std::chrono::milliseconds lobbyTimeout{std::chrono::seconds(5)};
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        /// Shard the next match is added to
+        std::size_t nextShard{0};
+        /// Flag that keeps the shards running
+        std::atomic<bool> running{true};
+
+        /// All the running matches, for the lobby and the reports
+        std::vector<std::shared_ptr<Match>> matches;
+        /// Clients that take part in a running match
+        std::set<unsigned int> busyClients;
+        /// Time each waiting client entered the lobby
+        std::map<unsigned int, TickScheduler::Clock::time_point> lobby;
+        /// Protects the matches, the busy clients and the lobby
+        std::mutex matchesMutex;
+        unsigned int nextMatchId{0};
+
+        /// Takes the due match with the earliest due time from the shard, or nothing
+        static std::shared_ptr<Match> takeDueMatch(Shard& shard, TickScheduler::Clock::time_point now);
+        /// Takes the match whose physics was queued first on the shard, or nothing
+        static std::shared_ptr<Match> takeWorldStep(Shard& shard);
+        /// Wakes the shard thread if it sleeps
+        static void wake(Shard& shard);
+        /// Starts the matches the lobby has enough players for
+        void startMatches();
+        /// Removes the finished matches and returns their clients to the lobby
+        void retireMatches();
+        /**
+         * Implementation of the shard thread.
+         * @param[in] host host instance
+         * @param[in] shardNo number of the shard run by the thread
+         */
+        static void shardThreadFunc(MatchHost* host, std::size_t shardNo);
+    };
+
+} // namespace amgame
+
+#endif /* AMGAME_MATCH_HOST_H_ */
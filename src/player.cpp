@@ -2,13 +2,16 @@
 
 #include "amgame.h"
 
+#include <atomic>
+
 namespace amgame {
 
 
-    static int playerCount;
+    /// Shared by the games running on different threads
+    static std::atomic<int> playerCount;
 
-    Player::Player(Game& game, engine::World& world, std::string name, std::string description, std::string helloMessage, unsigned int clientId) :
-        game(game), enginePlayer(world.addPlayer()), clientId(clientId), name(name) {
+    Player::Player(Game& game, physics::World& world, std::string name, std::string description, std::string helloMessage, unsigned int clientId) :
+        enginePlayer(world.addPlayer()), clientId(clientId), name(name), game(game) {
         lastHp = enginePlayer.hp();
         playerCount++;
     }
@@ -19,8 +22,7 @@ namespace amgame {
 
     void Player::updateSprite() {
         if (enginePlayer.alive()) {
-            int radius = (int)enginePlayer.getRadius();
-            lastHp     = enginePlayer.hp();
+            lastHp = enginePlayer.hp();
         }
     }
 
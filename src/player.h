@@ -2,7 +2,7 @@
 #define AMGAME_PLAYER_H_
 #pragma once
 
-#include "engine.hpp"
+#include "physics.hpp"
 #include "remote_connection.h"
 
 
@@ -11,12 +11,12 @@ namespace amgame {
 
     class Player {
       public:
-        engine::Player& enginePlayer; ///< player representation in physics engine
+        physics::Player& enginePlayer; ///< player representation in physics engine
         int             lastHp;
         char            hpText[10];
         unsigned int    clientId; ///< remote client id
         std::string     name;
-        Player(Game& game, engine::World& world, std::string name, std::string description, std::string helloMessage, unsigned int clientId);
+        Player(Game& game, physics::World& world, std::string name, std::string description, std::string helloMessage, unsigned int clientId);
         ~Player();
 
         void updateSprite();
@@ -91,7 +91,7 @@ namespace amgame {
         std::string ip;   ///< IP address of the remote player
         std::string port; ///< port used on the remote player side
 
-        RemoteConnection(const char* ip_, const char* port_) : ip(ip_), port(port_), connectionSocket(INVALID_SOCKET), alive(false), identified(false), connectionThreadHandle(0) {
+        RemoteConnection(const char* ip_, const char* port_) : connectionSocket(INVALID_SOCKET), connectionThreadHandle(0), alive(false), identified(false), ip(ip_), port(port_) {
         }
 
         ~RemoteConnection() = default;
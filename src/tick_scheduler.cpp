@@ -0,0 +1,57 @@
+#include "tick_scheduler.h"
+
+#include <iostream>
+#include <syncstream>
+
+namespace amgame {
+
+    TickScheduler::TickScheduler(std::chrono::microseconds period) : period(period), tickStart(Clock::now()) {}
+
+    void TickScheduler::setPeriod(std::chrono::microseconds period) {
+        this->period = period;
+    }
+
+    std::size_t TickScheduler::addPhase(std::string name, std::chrono::microseconds budget) {
+        phases.push_back({std::move(name), budget});
+        return phases.size() - 1;
+    }
+
+    bool TickScheduler::setBudget(std::string_view name, std::chrono::microseconds budget) {
+        for (auto& phase : phases) {
+            if (phase.name == name) {
+                phase.budget = budget;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void TickScheduler::restart() {
+        tickStart = Clock::now();
+    }
+
+    TickScheduler::Clock::time_point TickScheduler::finishTick() {
+        const auto now     = Clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - tickStart);
+        lastTickDuration   = elapsed;
+        for (auto& phase : phases) {
+            if ((phase.budget.count() > 0) && (phase.elapsed > phase.budget)) {
+                phase.overruns++;
+                std::osyncstream(std::cout) << "Tick " << tickCount << ": " << phase.name << " took " << phase.elapsed.count() << " us (budget " << phase.budget.count() << " us)"
+                                            << std::endl;
+            }
+            phase.elapsed = std::chrono::microseconds(0);
+        }
+        tickCount++;
+        if (elapsed > period) {
+            tickOverruns++;
+            std::osyncstream(std::cout) << "Tick " << (tickCount - 1) << " took " << elapsed.count() << " us (period " << period.count() << " us)" << std::endl;
+            // start over instead of running the missed ticks back-to-back
+            tickStart = now;
+            return tickStart;
+        }
+        tickStart += period;
+        return tickStart;
+    }
+
+} // namespace amgame
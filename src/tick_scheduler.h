@@ -0,0 +1,105 @@
+#ifndef AMGAME_TICK_SCHEDULER_H_
+#define AMGAME_TICK_SCHEDULER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace amgame {
+
+    /**
+     * Runs the game ticks at a fixed rate on the monotonic clock.
+     *
+     * A tick is made of phases, each with its own time budget. The phases that run over their budget and the ticks that run
+     * over the period are reported. A tick that runs late does not make the next ones catch up - the schedule starts over from it.
+     */
+    class TickScheduler {
+      public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * Constructs a tick scheduler.
+         *
+         * @param[in] period time between the starts of two ticks
+         */
+        explicit TickScheduler(std::chrono::microseconds period);
+
+        /**
+         * Sets the time between the starts of two ticks. Takes effect with the next tick.
+         */
+        void setPeriod(std::chrono::microseconds period);
+
+        std::chrono::microseconds getPeriod() const { return period; }
+
+        /**
+         * Adds a phase.
+         *
+         * @param[in] name name of the phase, used in the reports
+         * @param[in] budget time the phase may take in a single tick, 0 - no budget
+         * @return identifier of the phase
+         */
+        std::size_t addPhase(std::string name, std::chrono::microseconds budget);
+
+        /**
+         * Sets the time budget of the phase with the given name.
+         *
+         * @return false if there is no such phase
+         */
+        bool setBudget(std::string_view name, std::chrono::microseconds budget);
+
+        std::chrono::microseconds getBudget(std::size_t phase) const { return phases[phase].budget; }
+
+        /**
+         * Runs a part of the tick, timed as the given phase.
+         */
+        template<typename F> void run(std::size_t phase, F&& f) {
+            const auto start = Clock::now();
+            f();
+            phases[phase].elapsed += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+        }
+
+        /**
+         * Starts the schedule over from now, e.g. after waiting for the clients.
+         */
+        void restart();
+
+        /**
+         * Reports the overruns of the tick and schedules the next one.
+         *
+         * @return start of the next tick - the caller waits for it, or does something else meanwhile
+         */
+        Clock::time_point finishTick();
+
+        /// Number of finished ticks
+        std::size_t getTickCount() const { return tickCount; }
+
+        /// Number of ticks that ran over the period
+        std::size_t getTickOverruns() const { return tickOverruns; }
+
+        /// Time from the scheduled start to the end of the last finished tick
+        std::chrono::microseconds getLastTickDuration() const { return lastTickDuration; }
+
+      private:
+        struct Phase {
+            std::string               name;
+            std::chrono::microseconds budget;
+            /// Time taken by the phase in the current tick
+            std::chrono::microseconds elapsed{0};
+            /// Number of ticks in which the phase ran over its budget
+            std::size_t overruns{0};
+        };
+
+        std::chrono::microseconds period;
+        std::vector<Phase>        phases;
+        /// Start of the current tick
+        Clock::time_point         tickStart;
+        std::size_t               tickCount{0};
+        std::size_t               tickOverruns{0};
+        std::chrono::microseconds lastTickDuration{0};
+    };
+
+} // namespace amgame
+
+#endif /* AMGAME_TICK_SCHEDULER_H_ */